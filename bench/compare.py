@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+# Compares two titan_bench JSON results and fails if anything got slower than the threshold.
+#
+#   titan_bench --benchmark_out=baseline.json --benchmark_out_format=json
+#   (make changes, rebuild)
+#   titan_bench --benchmark_out=current.json --benchmark_out_format=json
+#   python3 compare.py baseline.json current.json --threshold 10
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    results = {}
+    for bench in data["benchmarks"]:
+        # With --benchmark_repetitions only compare the median
+        if bench.get("run_type") == "aggregate" and bench.get("aggregate_name") != "median":
+            continue
+        name = bench.get("run_name", bench["name"])
+        results[name] = bench["real_time"]
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare titan_bench results against a baseline")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=10.0, help="Allowed slowdown in percent")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    regressions = 0
+    for name, time in current.items():
+        if name not in baseline:
+            print(f"{name:60} new")
+            continue
+        change = (time - baseline[name]) / baseline[name] * 100.0
+        status = ""
+        if change > args.threshold:
+            status = "REGRESSION"
+            regressions += 1
+        print(f"{name:60} {change:+7.1f}% {status}")
+
+    if regressions:
+        print(f"{regressions} benchmark(s) regressed more than {args.threshold}%")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
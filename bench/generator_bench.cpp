@@ -0,0 +1,106 @@
+#include <benchmark/benchmark.h>
+
+#include "generators/noise.hpp"
+#include "generators/grid_mesh.hpp"
+#include "generators/heightmap_terrain.hpp"
+#include "renderer/util.hpp"
+
+#include <vector>
+
+namespace {
+
+// Terrain with only a heightmap, which is all the sampling functions need
+titan::HeightmapTerrain make_heightmap(size_t size) {
+    titan::HeightmapTerrain terrain;
+    titan::PerlinNoise noise(1337);
+    terrain.height_map = noise.get_buffer_float(size, 4);
+    terrain.heightmap_width = size;
+    terrain.heightmap_height = size;
+    terrain.width = 80.0f;
+    terrain.length = 80.0f;
+    terrain.height_scale = 100.0f;
+    return terrain;
+}
+
+constexpr float mesh_size = 10.0f;
+
+// Texcoords span the whole mesh, so they can be used to sample the heightmap
+titan::GridMeshOptions grid_options() {
+    titan::GridMeshOptions options;
+    options.tex_w = mesh_size;
+    options.tex_h = mesh_size;
+    return options;
+}
+
+template<typename T>
+void BM_generate_noise(benchmark::State& state) {
+    size_t const size = state.range(0);
+    size_t const octaves = state.range(1);
+    titan::PerlinNoise noise(1337);
+    std::vector<T> buffer(size * size);
+    for (auto _ : state) {
+        noise.get_buffer(buffer.data(), size, octaves);
+        benchmark::DoNotOptimize(buffer.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * size * size);
+}
+BENCHMARK_TEMPLATE(BM_generate_noise, unsigned char)->ArgsProduct({{256, 1024}, {1, 4, 8}})->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_generate_noise, float)->ArgsProduct({{256, 1024}, {1, 4, 8}})->Unit(benchmark::kMillisecond);
+
+void BM_create_grid_mesh(benchmark::State& state) {
+    size_t const resolution = state.range(0);
+    for (auto _ : state) {
+        titan::GridMesh mesh = titan::create_grid_mesh(mesh_size, mesh_size, resolution, grid_options());
+        benchmark::DoNotOptimize(mesh.vertices.data());
+    }
+    state.SetItemsProcessed(state.iterations() * resolution * resolution);
+}
+BENCHMARK(BM_create_grid_mesh)->RangeMultiplier(2)->Range(16, 256);
+
+void BM_calculate_normals(benchmark::State& state) {
+    size_t const resolution = state.range(0);
+    titan::HeightmapTerrain const terrain = make_heightmap(1024);
+    titan::GridMesh const mesh = titan::create_grid_mesh(mesh_size, mesh_size, resolution, grid_options());
+    titan::GridMesh work = mesh;
+    for (auto _ : state) {
+        // Normals are accumulated, so start from the zeroed mesh every time
+        state.PauseTiming();
+        work.vertices = mesh.vertices;
+        state.ResumeTiming();
+        titan::calculate_normals(terrain, work);
+        benchmark::DoNotOptimize(work.vertices.data());
+    }
+    state.SetItemsProcessed(state.iterations() * resolution * resolution);
+}
+BENCHMARK(BM_calculate_normals)->RangeMultiplier(2)->Range(16, 256);
+
+void BM_sample_height_linear(benchmark::State& state) {
+    titan::HeightmapTerrain const terrain = make_heightmap(state.range(0));
+    // Walk a fixed pattern over the whole heightmap
+    constexpr size_t samples = 4096;
+    float sum = 0;
+    for (auto _ : state) {
+        for (size_t i = 0; i < samples; ++i) {
+            float const x = (float)(i % 64) / 63.0f;
+            float const y = (float)(i / 64) / 63.0f;
+            sum += titan::sample_height_linear(terrain, x, y);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * samples);
+}
+BENCHMARK(BM_sample_height_linear)->Arg(256)->Arg(4096);
+
+void BM_build_heightmap_mips(benchmark::State& state) {
+    titan::HeightmapTerrain const terrain = make_heightmap(state.range(0));
+    std::vector<std::vector<float>> levels;
+    for (auto _ : state) {
+        titan::renderer::build_heightmap_mips(terrain.height_map.data(), terrain.heightmap_width, terrain.heightmap_height, levels);
+        benchmark::DoNotOptimize(levels.data());
+    }
+    state.SetItemsProcessed(state.iterations() * terrain.height_map.size());
+}
+BENCHMARK(BM_build_heightmap_mips)->Arg(1024)->Arg(4096)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+}
@@ -0,0 +1,79 @@
+#include "gl_bench.hpp"
+
+#include <benchmark/benchmark.h>
+#include <glad/glad.h>
+
+#include "generators/heightmap_terrain.hpp"
+#include "renderer/headless_context.hpp"
+#include "renderer/swap_buffer.hpp"
+#include "renderer/terrain_renderer.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace titan::bench {
+
+namespace {
+
+void BM_swap_buffer_upload(benchmark::State& state) {
+    size_t const size = state.range(0);
+    std::vector<unsigned char> data(size, 1);
+    renderer::SwapBuffer buffer;
+    buffer.create(GL_ARRAY_BUFFER, size);
+    for (auto _ : state) {
+        buffer.start_data_upload(data.data(), size);
+        buffer.wait_for_upload();
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+}
+
+void BM_update_lod_distance(benchmark::State& state) {
+    HeightmapTerrainInfo info;
+    info.width = 80.0f;
+    info.length = 80.0f;
+    info.height_scale = 100.0f;
+    info.max_lod = 32;
+    info.noise_seed = 1337;
+    info.noise_size = 512;
+    info.noise_layers = 4;
+    HeightmapTerrain const terrain = create_heightmap_terrain(info);
+    renderer::TerrainRenderInfo render_info = renderer::make_terrain_render_info(terrain, terrain.max_lod / 2);
+    for (auto& chunk : render_info.chunks) {
+        renderer::await_all_data_upload(chunk);
+    }
+
+    // Fly over the terrain, so LODs actually change
+    float cam[3] = {0, 10, 0};
+    for (auto _ : state) {
+        cam[0] = cam[0] > info.width ? 0 : cam[0] + 0.5f;
+        cam[2] = cam[0];
+        renderer::update_lod_distance(render_info, terrain, glm::mat4(1.0f), cam);
+    }
+    glFinish();
+    state.SetItemsProcessed(state.iterations() * render_info.chunks.size());
+}
+
+renderer::HeadlessContext& get_context() {
+    // Lives until the program exits, all GL benchmarks share it
+    static renderer::HeadlessContext context;
+    return context;
+}
+
+}
+
+void register_gl_benchmarks() {
+    try {
+        get_context() = renderer::create_headless_context(64, 64);
+    } catch (std::runtime_error const& e) {
+        std::cerr << "Skipping GL benchmarks: " << e.what() << std::endl;
+        return;
+    }
+
+    benchmark::RegisterBenchmark("BM_swap_buffer_upload", BM_swap_buffer_upload)->RangeMultiplier(4)->Range(64 * 1024, 16 * 1024 * 1024)
+        // The copy happens on the upload workers, CPU time of the main thread would hide it
+        ->UseRealTime();
+    benchmark::RegisterBenchmark("BM_update_lod_distance", BM_update_lod_distance)->Unit(benchmark::kMicrosecond);
+}
+
+}
@@ -0,0 +1,12 @@
+#ifndef TITAN_BENCH_GL_BENCH_HPP_
+#define TITAN_BENCH_GL_BENCH_HPP_
+
+namespace titan::bench {
+
+// Creates a headless GL context and registers the benchmarks that need one. Does nothing if there is no
+// context available, for example when built without TITAN_HEADLESS
+void register_gl_benchmarks();
+
+}
+
+#endif
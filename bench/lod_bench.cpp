@@ -0,0 +1,65 @@
+#include <benchmark/benchmark.h>
+
+#include "renderer/chunk_lod_state.hpp"
+#include "renderer/lod_schedule.hpp"
+
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Chunks on a square grid, one unit apart
+void make_grid_state(titan::renderer::ChunkLODState& state, size_t count) {
+    titan::renderer::resize_chunk_lod_state(state, count);
+    size_t const side = (size_t)std::ceil(std::sqrt((double)count));
+    for (size_t i = 0; i < count; ++i) {
+        float const center[3] = {(float)(i % side), (float)(i / side), 0.0f};
+        titan::renderer::set_chunk_center(state, i, center);
+    }
+    titan::renderer::set_chunk_transform(state, glm::mat4(1.0f));
+}
+
+// The CPU side of update_lod_distance over every chunk: distances and distance based LODs
+void BM_distance_lods(benchmark::State& state) {
+    size_t const count = state.range(0);
+    titan::renderer::ChunkLODState lod_state;
+    make_grid_state(lod_state, count);
+    float cam[3] = {0, 0, 10};
+    for (auto _ : state) {
+        cam[0] += 0.1f;
+        titan::renderer::calculate_chunk_distances(lod_state, cam);
+        titan::renderer::calculate_distance_lods(lod_state, 5.0f, 200.0f, 16);
+        benchmark::DoNotOptimize(lod_state.target_lod.data());
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_distance_lods)->RangeMultiplier(10)->Range(1000, 100000);
+
+// Incremental update_lod_distance: only chunks whose slack ran out are evaluated
+void BM_lod_schedule(benchmark::State& state) {
+    size_t const count = state.range(0);
+    titan::renderer::ChunkLODState lod_state;
+    make_grid_state(lod_state, count);
+    titan::renderer::LODSchedule schedule;
+    float const band_width = (200.0f - 5.0f) / 16;
+    titan::renderer::create_lod_schedule(schedule, count, band_width / 4.0f);
+    float cam[3] = {0, 0, 10};
+    size_t evaluated = 0;
+    for (auto _ : state) {
+        cam[0] += 0.1f;
+        titan::renderer::advance_lod_schedule(schedule, cam);
+        for (std::uint32_t const chunk_id : schedule.due) {
+            float const distance = titan::renderer::calculate_chunk_distance(lod_state, chunk_id, cam);
+            // Distance to the nearest band edge
+            float const band_pos = (distance - 5.0f) / band_width;
+            float const slack = std::min(band_pos - std::floor(band_pos), std::ceil(band_pos) - band_pos) * band_width;
+            titan::renderer::schedule_chunk(schedule, chunk_id, slack);
+        }
+        evaluated += schedule.due.size();
+    }
+    state.counters["evaluated_per_frame"] = benchmark::Counter((double)evaluated / state.iterations());
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_lod_schedule)->RangeMultiplier(10)->Range(1000, 100000);
+
+}
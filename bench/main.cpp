@@ -0,0 +1,14 @@
+#include <benchmark/benchmark.h>
+
+#include "gl_bench.hpp"
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) { return 1; }
+
+    // Only registers anything when a GL context can be created
+    titan::bench::register_gl_benchmarks();
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+}
@@ -0,0 +1,73 @@
+#include <benchmark/benchmark.h>
+
+#include "renderer/occlusion.hpp"
+
+#include <vector>
+
+namespace {
+
+// side * side chunks, one unit apart. Everything is 1 unit high, except for a 10 unit high ridge along the whole
+// third row
+std::vector<titan::renderer::HeightfieldBox> make_ridge_boxes(size_t side) {
+    std::vector<titan::renderer::HeightfieldBox> boxes(side * side);
+    for (size_t y = 0; y < side; ++y) {
+        float const height = y == 2 ? 10.0f : 1.0f;
+        for (size_t x = 0; x < side; ++x) {
+            boxes[y * side + x] = {(float)x, (float)y, (float)x + 1.0f, (float)y + 1.0f, height - 1.0f, height};
+        }
+    }
+    return boxes;
+}
+
+// Occlusion has to be conservative, a wrong answer would make terrain disappear. Returns an error message, or nullptr
+char const* check_occlusion(size_t side) {
+    std::vector<titan::renderer::HeightfieldBox> const boxes = make_ridge_boxes(side);
+    titan::renderer::HorizonOccluder occluder;
+
+    // Camera in the first row, just above the ground and looking at the ridge
+    float const low_cam[3] = {side / 2.0f, 0.5f, 2.0f};
+    std::vector<unsigned char> visible(boxes.size(), 1);
+    titan::renderer::occlude_chunks(occluder, boxes, low_cam, visible);
+    for (size_t y = 0; y < side; ++y) {
+        for (size_t x = 0; x < side; ++x) {
+            bool const hidden = !visible[y * side + x];
+            if (y <= 2 && hidden) { return "A chunk in front of the ridge or on it was occluded"; }
+            // Away from the ends of the ridge, everything behind it is hidden. Except for the row right behind it, which
+            // is partly closer to the camera than the far side of the ridge
+            bool const behind_middle = y > 3 && x >= side / 4 && x < side - side / 4;
+            if (behind_middle && !hidden) { return "A chunk behind the ridge was not occluded"; }
+        }
+    }
+
+    // High above the ridge, everything is in view
+    float const high_cam[3] = {side / 2.0f, 0.5f, 1000.0f};
+    visible.assign(boxes.size(), 1);
+    titan::renderer::OcclusionStats const stats = titan::renderer::occlude_chunks(occluder, boxes, high_cam, visible);
+    if (stats.occluded != 0) { return "A chunk was occluded with the camera above the ridge"; }
+    return nullptr;
+}
+
+void BM_occlude_chunks(benchmark::State& state) {
+    size_t const side = state.range(0);
+    if (char const* error = check_occlusion(side)) {
+        state.SkipWithError(error);
+        return;
+    }
+
+    std::vector<titan::renderer::HeightfieldBox> const boxes = make_ridge_boxes(side);
+    titan::renderer::HorizonOccluder occluder;
+    std::vector<unsigned char> visible(boxes.size());
+    float cam[3] = {side / 2.0f, 0.5f, 2.0f};
+    size_t occluded = 0;
+    for (auto _ : state) {
+        cam[0] += 0.001f;
+        visible.assign(boxes.size(), 1);
+        occluded += titan::renderer::occlude_chunks(occluder, boxes, cam, visible).occluded;
+        benchmark::DoNotOptimize(visible.data());
+    }
+    state.counters["occluded_per_frame"] = benchmark::Counter((double)occluded / state.iterations());
+    state.SetItemsProcessed(state.iterations() * boxes.size());
+}
+BENCHMARK(BM_occlude_chunks)->RangeMultiplier(4)->Range(16, 256);
+
+}
@@ -9,6 +9,17 @@ layout(location = 1) uniform mat4 view;
 layout(location = 2) uniform mat4 projection;
 layout(location = 3) uniform sampler2D height_map;
 layout(location = 4) uniform float height_scale;
+// Coarser LODs sample a coarser mip level of the heightmap, see heightmap_base_mip_level
+layout(location = 9) uniform float height_map_base_level;
+layout(location = 10) uniform float lod;
+layout(location = 11) uniform float chunk_size;
+// Virtual heightmap, see VirtualHeightmap. height_map is the page atlas when this is used
+layout(location = 12) uniform bool virtual_height_map;
+layout(location = 13) uniform usampler2D page_table;
+layout(location = 14) uniform sampler2D fallback_height_map;
+// Heightmap width and height, page size and atlas slot size in texels
+layout(location = 15) uniform vec4 virtual_layout;
+layout(location = 16) uniform float fallback_level_offset;
 
 
 out vec2 TexCoords;
@@ -19,10 +30,33 @@ out vec4 CamPosViewSpace;
 
 out float Height;
 
+// Vertices on chunk borders are shared with neighbours that may have another LOD. They always sample level 0,
+// so both sides end up at the same height
+float height_map_level(vec2 pos, float lod) {
+    vec2 border_distance = abs(pos / chunk_size - round(pos / chunk_size));
+    if (min(border_distance.x, border_distance.y) < 0.0001) { return 0.0; }
+    return max(height_map_base_level + lod, 0.0);
+}
+
+float sample_height_map(vec2 uv, float level) {
+    if (!virtual_height_map) { return textureLod(height_map, uv, level).x; }
+
+    vec2 texel = uv * virtual_layout.xy;
+    ivec2 page = clamp(ivec2(texel / virtual_layout.z), ivec2(0), textureSize(page_table, 0) - 1);
+    uvec4 entry = texelFetch(page_table, page, 0);
+    // The atlas only holds level 0
+    if (level >= 1.0 || entry.z == 0u) {
+        return textureLod(fallback_height_map, uv, max(level - fallback_level_offset, 0.0)).x;
+    }
+    // Skip the border texel at the start of the slot
+    vec2 atlas_texel = vec2(entry.xy) * virtual_layout.w + 1.0 + (texel - vec2(page) * virtual_layout.z);
+    return textureLod(height_map, atlas_texel / vec2(textureSize(height_map, 0)), 0.0).x;
+}
+
 void main() {   
     Normal = iNormal;
     TexCoords = iTexCoords;
-    float height = texture(height_map, TexCoords).x;
+    float height = sample_height_map(TexCoords, height_map_level(iPos, lod));
     Height = height;
     CamPosViewSpace = view * model * vec4(iPos.xy, (1 - height) * height_scale, 1.0);
     FragPos = vec3(model * vec4(iPos.xy, height, 1));
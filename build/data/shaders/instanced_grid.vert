@@ -0,0 +1,84 @@
+#version 450 core
+
+layout (location = 0) in vec2 iPos;
+// Per instance
+layout (location = 3) in vec2 iChunkOffset;
+layout (location = 4) in float iLod;
+
+layout(location = 0) uniform mat4 model;
+layout(location = 1) uniform mat4 view;
+layout(location = 2) uniform mat4 projection;
+layout(location = 3) uniform sampler2D height_map;
+layout(location = 4) uniform float height_scale;
+// Width and length of the terrain in worldspace units
+layout(location = 8) uniform vec2 terrain_size;
+// See grid.vert, the LOD comes from the instance data here
+layout(location = 9) uniform float height_map_base_level;
+layout(location = 11) uniform float chunk_size;
+// Virtual heightmap, see VirtualHeightmap. height_map is the page atlas when this is used
+layout(location = 12) uniform bool virtual_height_map;
+layout(location = 13) uniform usampler2D page_table;
+layout(location = 14) uniform sampler2D fallback_height_map;
+// Heightmap width and height, page size and atlas slot size in texels
+layout(location = 15) uniform vec4 virtual_layout;
+layout(location = 16) uniform float fallback_level_offset;
+
+
+out vec2 TexCoords;
+out vec3 Normal;
+out vec3 FragPos;
+
+out vec4 CamPosViewSpace;
+
+out float Height;
+
+// Vertices on chunk borders are shared with neighbours that may have another LOD. They always sample level 0,
+// so both sides end up at the same height
+float height_map_level(vec2 pos, float lod) {
+    vec2 border_distance = abs(pos / chunk_size - round(pos / chunk_size));
+    if (min(border_distance.x, border_distance.y) < 0.0001) { return 0.0; }
+    return max(height_map_base_level + lod, 0.0);
+}
+
+vec2 height_map_size() {
+    return virtual_height_map ? virtual_layout.xy : vec2(textureSize(height_map, 0));
+}
+
+float sample_height_map(vec2 uv, float level) {
+    if (!virtual_height_map) { return textureLod(height_map, uv, level).x; }
+
+    vec2 texel = uv * virtual_layout.xy;
+    ivec2 page = clamp(ivec2(texel / virtual_layout.z), ivec2(0), textureSize(page_table, 0) - 1);
+    uvec4 entry = texelFetch(page_table, page, 0);
+    // The atlas only holds level 0
+    if (level >= 1.0 || entry.z == 0u) {
+        return textureLod(fallback_height_map, uv, max(level - fallback_level_offset, 0.0)).x;
+    }
+    // Skip the border texel at the start of the slot
+    vec2 atlas_texel = vec2(entry.xy) * virtual_layout.w + 1.0 + (texel - vec2(page) * virtual_layout.z);
+    return textureLod(height_map, atlas_texel / vec2(textureSize(height_map, 0)), 0.0).x;
+}
+
+// The patch mesh is shared between chunks, so normals can't be baked into the vertex data anymore
+vec3 heightmap_normal(vec2 uv, float level) {
+    vec2 texel = exp2(floor(level)) / height_map_size();
+    float left = sample_height_map(uv - vec2(texel.x, 0), level);
+    float right = sample_height_map(uv + vec2(texel.x, 0), level);
+    float down = sample_height_map(uv - vec2(0, texel.y), level);
+    float up = sample_height_map(uv + vec2(0, texel.y), level);
+    // Distance between the samples in worldspace units
+    vec2 step_size = 2.0 * texel * terrain_size;
+    return normalize(vec3(-(right - left) * height_scale / step_size.x, 1.0, -(up - down) * height_scale / step_size.y));
+}
+
+void main() {   
+    vec2 pos = iPos + iChunkOffset;
+    TexCoords = pos / terrain_size;
+    float level = height_map_level(pos, iLod);
+    Normal = heightmap_normal(TexCoords, level);
+    float height = sample_height_map(TexCoords, level);
+    Height = height;
+    CamPosViewSpace = view * model * vec4(pos, (1 - height) * height_scale, 1.0);
+    FragPos = vec3(model * vec4(pos, height, 1));
+    gl_Position = projection * view * model * vec4(pos, (1 - height) * height_scale, 1.0);
+}
\ No newline at end of file
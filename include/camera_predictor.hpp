@@ -0,0 +1,38 @@
+#ifndef TITAN_CAMERA_PREDICTOR_HPP_
+#define TITAN_CAMERA_PREDICTOR_HPP_
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace titan {
+
+// Extrapolates where the camera will be from its recent motion, so data the camera is about to need can be
+// loaded before it gets there.
+class CameraPredictor {
+public:
+    /**
+     * @param position: Camera position this frame
+     * @param time: Time of this frame, in seconds
+     */
+    void add_sample(glm::vec3 position, float time);
+
+    // Velocity in worldspace units per second, fitted over the last history_seconds of samples
+    glm::vec3 get_velocity() const;
+    glm::vec3 predict(float seconds_ahead) const;
+
+    // How much motion history is used to estimate the velocity. Longer is smoother but reacts slower to turns
+    float history_seconds = 0.25f;
+
+private:
+    struct Sample {
+        glm::vec3 position;
+        float time;
+    };
+
+    std::vector<Sample> samples;
+};
+
+}
+
+#endif
@@ -14,9 +14,12 @@ struct OrbitCamera {
     glm::vec3 distance_to_target = glm::vec3(1, 0, 1);
 private:
     glm::vec3 position;
+    // Sum of all delta times passed to update_cinematic_camera, so the path only depends on the simulated time
+    float time = 0;
 
     friend void update_cinematic_camera(OrbitCamera& camera, float delta_time);
     friend glm::mat4 get_view_matrix(OrbitCamera& camera, glm::vec3 world_up);
+    friend glm::vec3 get_position(OrbitCamera const& camera);
 };
 
 struct FollowCamera {
@@ -28,6 +31,7 @@ private:
 
     friend void update_cinematic_camera(FollowCamera& camera, float delta_time);
     friend glm::mat4 get_view_matrix(FollowCamera& camera, glm::vec3 world_up);
+    friend glm::vec3 get_position(FollowCamera const& camera);
 };
 
 struct StationaryCamera {
@@ -54,6 +58,9 @@ glm::mat4 get_view_matrix(OrbitCamera& camera, glm::vec3 world_up);
 glm::mat4 get_view_matrix(FollowCamera& camera, glm::vec3 world_up);
 glm::mat4 get_view_matrix(StationaryCamera& camera, glm::vec3 world_up);
 
+glm::vec3 get_position(OrbitCamera const& camera);
+glm::vec3 get_position(FollowCamera const& camera);
+
 }
 
 #endif
\ No newline at end of file
@@ -5,9 +5,23 @@
 #include <glad/glad.h>
 #include <glfw/glfw3.h>
 
+#include <optional>
+#include <string>
+
+#include "renderer/headless_context.hpp"
+
+// Renders a fixed number of frames offscreen along a fixed camera path, and writes the statistics of every frame to a file
+struct BenchmarkOptions {
+    size_t frames = 1000;
+    // Simulated time between frames, in seconds
+    float time_step = 1.0f / 60.0f;
+    std::string output_path = "benchmark.json";
+};
+
 class Application {
 public:
-    Application(size_t const width, size_t const height);
+    // Passing benchmark options runs the benchmark headless instead of opening a window
+    Application(size_t const width, size_t const height, std::optional<BenchmarkOptions> benchmark = std::nullopt);
     
     ~Application();
 
@@ -17,7 +31,12 @@ public:
 
 private:
     // Windowing
-    GLFWwindow* win;
+    GLFWwindow* win = nullptr;
+    titan::renderer::HeadlessContext headless_context;
+    size_t width;
+    size_t height;
+
+    std::optional<BenchmarkOptions> benchmark;
 
     // Timing
     float d_time = 0;
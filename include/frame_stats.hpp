@@ -0,0 +1,31 @@
+#ifndef TITAN_FRAME_STATS_HPP_
+#define TITAN_FRAME_STATS_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace titan {
+
+struct FrameStats {
+    // Time spent on the CPU until all commands for the frame were submitted
+    float cpu_ms = 0;
+    // Time until the GPU finished the frame
+    float frame_ms = 0;
+
+    size_t draw_calls = 0;
+    size_t triangles = 0;
+    size_t upload_bytes = 0;
+};
+
+/**
+ * Writes all frames and a small summary to a JSON file. Throws if the file can't be opened.
+ * @param renderer: Name of the GL renderer, so results from different drivers aren't mixed up
+ * @param time_step: Simulated time between frames, in seconds
+ */
+void write_frame_stats_json(std::string const& path, std::vector<FrameStats> const& frames, 
+                            std::string const& renderer, float time_step);
+
+}
+
+#endif
@@ -8,6 +8,8 @@
 
 namespace titan {
 
+class NoiseLayerCache;
+
 struct HeightmapTerrain {
     struct Chunk {
         std::vector<GridMesh> meshes;
@@ -19,6 +21,14 @@ struct HeightmapTerrain {
         float yoffset;
 
         float height_at_center;
+
+        // Lowest and highest heightmap value inside this chunk, used for bounding volumes
+        float min_height;
+        float max_height;
+
+        // Maximum vertical distance in worldspace units between each LOD mesh and the highest detail mesh,
+        // indexed by LOD. Never decreases with the LOD index.
+        std::vector<float> lod_error;
     };
 
     struct Mesh {
@@ -29,6 +39,8 @@ struct HeightmapTerrain {
 
     // Meshes go from high LOD to low LOD
     Mesh mesh;
+    // Values between 0 and 1, multiplied by height_scale for the worldspace height. The GPU heightmap formats clamp to
+    // that range too, see heightmap_noise_scale
     std::vector<float> height_map;
 
     // Misc  info
@@ -65,11 +77,29 @@ struct HeightmapTerrainInfo {
     size_t noise_seed;
     size_t noise_size = 256;
     size_t noise_layers = 8;
+    // Amplitude of every octave relative to the previous one. Above about 0.5 the octaves can add up to more than 1,
+    // the heightmap is scaled back to 0-1 in that case
     float noise_persistence = 0.5f;
+    // Optional, keeps the noise octaves around for the next terrain generated with the same cache. Makes changing
+    // noise_persistence or noise_layers cheap, see NoiseLayerCache
+    NoiseLayerCache* noise_cache = nullptr;
 };
 
 HeightmapTerrain create_heightmap_terrain(HeightmapTerrainInfo const& info);
 
+// Highest value the unscaled noise of info can reach, the sum of the octave amplitudes
+float max_noise_height(HeightmapTerrainInfo const& info);
+
+// Scale applied to the noise so the heightmap stays between 0 and 1. 1 unless max_noise_height is above 1, which happens
+// for a persistence above about 0.5
+float heightmap_noise_scale(HeightmapTerrainInfo const& info);
+
+// Bilinearly filtered heightmap value, x and y go from 0 to 1 over the heightmap
+float sample_height_linear(HeightmapTerrain const& terrain, float x, float y);
+// Accumulates face normals into the vertices of mesh and normalizes them. Heights are sampled at the vertex texcoords.
+// The normals in mesh must be zero before calling this
+void calculate_normals(HeightmapTerrain const& terrain, GridMesh& mesh);
+
 }
 
 #endif
\ No newline at end of file
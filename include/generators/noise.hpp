@@ -22,6 +22,26 @@ private:
     std::mt19937 random_engine;
 };
 
+// Keeps the unscaled layer of every octave for the last seed and size. Changing the persistence then only re-sums the
+// cached layers, and adding octaves only generates the new ones. Costs size * size floats of memory per octave.
+// Not thread safe, use one cache per thread.
+class NoiseLayerCache {
+public:
+    // Same result as PerlinNoise(seed).get_buffer(buffer, size, octaves, persistence). A new seed or size clears the cache
+    void get_buffer(float* buffer, size_t seed, size_t size, size_t octaves = 1, float persistence = 0.5f);
+    std::vector<float> get_buffer_float(size_t seed, size_t size, size_t octaves = 1, float persistence = 0.5f);
+
+    void clear();
+    size_t cached_octaves() const;
+    // Bytes taken up by the cached layers
+    size_t memory_usage() const;
+
+private:
+    size_t cached_seed = 0;
+    size_t cached_size = 0;
+    std::vector<std::vector<float>> layers;
+};
+
 } // namespace titan
 
 #endif
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifndef TITAN_TERRAIN_PREVIEW_HPP_
+#define TITAN_TERRAIN_PREVIEW_HPP_
+
+#include "heightmap_terrain.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace titan {
+
+struct TerrainPreviewInfo {
+    // Width and height of the preview heightmap, must be a power of 2. Values above noise_size are clamped to it.
+    // The noise is sampled at the same terrain coordinates as the full heightmap, only at fewer points, so the preview
+    // has the same large scale shape as the terrain create_heightmap_terrain builds
+    size_t size = 128;
+    size_t height_bins = 32;
+    // Bins between 0 and 90 degrees
+    size_t slope_bins = 18;
+    // Threads used by rank_terrain_seeds. 0 uses one per core
+    size_t worker_count = 0;
+    // rank_terrain_seeds only returns the best max_results previews. 0 returns all of them
+    size_t max_results = 0;
+};
+
+struct TerrainPreview {
+    size_t seed;
+    size_t size;
+    // size * size values, same scale as HeightmapTerrain::height_map
+    std::vector<float> height_map;
+
+    // Heights in worldspace coordinates
+    float min_height;
+    float max_height;
+    float mean_height;
+    float height_stddev;
+    // Bins from 0 to the highest height the noise settings can reach, so histograms of different seeds can be compared
+    std::vector<size_t> height_histogram;
+
+    // Slopes in degrees. Measured at the preview resolution, so they only describe the large scale shape and are lower
+    // than the slopes of the full resolution terrain
+    float mean_slope;
+    float max_slope;
+    std::vector<size_t> slope_histogram;
+
+    // Set by rank_terrain_seeds, higher is better
+    float score = 0.0f;
+};
+
+// Higher is better. Called from the worker threads, so it must be safe to call concurrently
+using TerrainPreviewScore = std::function<float(TerrainPreview const&)>;
+
+// Preview of the terrain create_heightmap_terrain(info) would build. Only generates the noise, no meshes.
+// info.noise_cache is not used
+TerrainPreview create_terrain_preview(HeightmapTerrainInfo const& info, TerrainPreviewInfo const& preview_info = {});
+
+/**
+ * Builds a preview for every seed in parallel, with info.noise_seed replaced by the seed.
+ * @param score Ranks the previews. Defaults to height_stddev, which prefers terrains with more relief
+ * @return The previews sorted from best to worst score
+ */
+std::vector<TerrainPreview> rank_terrain_seeds(HeightmapTerrainInfo const& info, std::vector<size_t> const& seeds,
+                                               TerrainPreviewInfo const& preview_info = {},
+                                               TerrainPreviewScore const& score = {});
+
+}
+
+#endif
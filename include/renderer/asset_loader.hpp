@@ -0,0 +1,59 @@
+#ifndef TITAN_RENDERER_ASSET_LOADER_HPP_
+#define TITAN_RENDERER_ASSET_LOADER_HPP_
+
+#include "renderer/gl_resource.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace titan::renderer {
+
+struct AssetLoaderInfo {
+    // Directory for decoded images with their mip chain, stored as .ttex files. Later runs read these instead of
+    // decoding the PNGs again. An empty path disables the cache
+    std::string cache_directory = "texture_cache";
+    // Threads decoding images, 0 uses one per core
+    size_t worker_count = 0;
+};
+
+// Loads a batch of textures and cubemaps. Every image, including every cubemap face, is decoded and mipmapped on a
+// worker thread. The calling thread uploads each image through a pixel buffer object as soon as it is decoded, so
+// uploads overlap with decoding the rest of the batch.
+struct AssetLoader {
+    struct Image {
+        std::string path;
+        bool flip = false;
+    };
+
+    struct Asset {
+        // 1 image for textures, 6 for cubemaps. Empty for a cubemap without descriptor
+        std::vector<Image> images;
+        bool cubemap = false;
+    };
+
+    AssetLoaderInfo info;
+    std::vector<Asset> assets;
+};
+
+/**
+ * Queues a texture, loaded like load_texture.
+ * @return Index of the texture in the result of load_assets
+ */
+size_t add_texture(AssetLoader& loader, std::string const& path);
+/**
+ * Queues a cubemap, loaded like load_cubemap. Reads the descriptor right away.
+ * @return Index of the cubemap in the result of load_assets
+ */
+size_t add_cubemap(AssetLoader& loader, std::string const& descriptor_path);
+
+/**
+ * Decodes and uploads everything that was queued, and blocks until it is done. Must be called from the thread owning
+ * the GL context. Clears the queue afterwards.
+ * @return Textures in the order the assets were added. Assets that could not be loaded are empty
+ */
+std::vector<GLTexture> load_assets(AssetLoader& loader);
+
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef TITAN_RENDERER_BUFFER_POOL_HPP_
+#define TITAN_RENDERER_BUFFER_POOL_HPP_
+
+#include "renderer/gl_resource.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace titan::renderer {
+
+// Sub-allocates fixed size blocks out of large persistently mapped buffers (slabs). Every size class has its own
+// block size, the terrain renderer uses one size class per LOD so a chunk only takes up the memory of the LODs it holds.
+class BufferPool {
+public:
+    static constexpr size_t no_size_class = static_cast<size_t>(-1);
+
+    struct Allocation {
+        unsigned int buffer = 0;
+        // Offset of the block in the buffer, in bytes
+        size_t offset = 0;
+        // Pointer to the start of the block in the persistent mapping
+        void* mapped = nullptr;
+
+        size_t size_class = no_size_class;
+        size_t slab = 0;
+        size_t block = 0;
+    };
+
+    struct SizeClassUsage {
+        size_t block_size = 0;
+        size_t blocks_used = 0;
+        size_t blocks_reserved = 0;
+        size_t bytes_used = 0;
+        // GPU memory taken up by the slabs of this size class
+        size_t bytes_reserved = 0;
+    };
+
+    BufferPool() = default;
+    BufferPool(BufferPool&& rhs);
+    // Releases the current pool like the destructor does
+    BufferPool& operator=(BufferPool&& rhs);
+    // Slabs are queued in the DeletionQueue, blocks still waiting for their fence go with them
+    ~BufferPool();
+
+    /**
+     * @param block_sizes: Block size in bytes of every size class
+     * @param budget: Maximum amount of bytes in use before over_budget() reports true
+     */
+    void create(std::vector<size_t> const& block_sizes, size_t budget);
+
+    // Never fails, the budget is only a hint for the caller to start evicting
+    Allocation allocate(size_t size_class);
+    // Makes sure the next blocks allocations of size_class don't create slabs. Creates at most one slab per call, so
+    // the cost of creating them can be spread over several frames. Returns true once no slab has to be created anymore
+    bool reserve(size_t size_class, size_t blocks);
+    // The block is only reused after the GPU is done with all commands issued before this call
+    void free(Allocation& allocation);
+    // Recycles freed blocks that the GPU no longer uses and releases empty slabs. Call once per frame
+    void collect();
+
+    bool over_budget() const;
+    size_t bytes_used() const;
+    size_t budget() const;
+    std::vector<SizeClassUsage> usage() const;
+
+private:
+    struct Slab {
+        // Empty when the slab was released
+        GLBuffer buffer;
+        void* mapped = nullptr;
+        std::vector<size_t> free_blocks;
+        size_t used = 0;
+    };
+
+    struct SizeClass {
+        size_t block_size = 0;
+        size_t blocks_per_slab = 0;
+        std::vector<Slab> slabs;
+    };
+
+    struct PendingFree {
+        Allocation allocation;
+        // GLsync
+        void* fence;
+    };
+
+    void create_slab(SizeClass& size_class, Slab& slab);
+    void delete_pending_fences();
+
+    std::vector<SizeClass> size_classes;
+    std::vector<PendingFree> pending_frees;
+    size_t used_bytes = 0;
+    size_t max_bytes = 0;
+};
+
+}
+
+#endif
\ No newline at end of file
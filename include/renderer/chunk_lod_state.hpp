@@ -0,0 +1,56 @@
+#ifndef TITAN_RENDERER_CHUNK_LOD_STATE_HPP_
+#define TITAN_RENDERER_CHUNK_LOD_STATE_HPP_
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace titan::renderer {
+
+// Per chunk data that LOD selection touches every frame, in structure of arrays layout so 4 chunks can be
+// evaluated with a single SIMD instruction. The LOD buffers themselves are only touched when a chunk actually
+// changes LOD. The arrays are padded to a multiple of 4, results for the padding are ignored.
+struct ChunkLODState {
+    // Chunk centers in terrain space
+    std::vector<float> local_x;
+    std::vector<float> local_y;
+    std::vector<float> local_z;
+    // Chunk centers in worldspace, only recalculated when the terrain transform changes
+    std::vector<float> world_x;
+    std::vector<float> world_y;
+    std::vector<float> world_z;
+
+    // Distance to the camera at the last update
+    std::vector<float> distance;
+    // LOD that is currently drawn, and LOD the last selection wants
+    std::vector<std::uint32_t> current_lod;
+    std::vector<std::uint32_t> target_lod;
+
+    glm::mat4 transform = glm::mat4(1.0f);
+    bool has_transform = false;
+
+    size_t count = 0;
+};
+
+void resize_chunk_lod_state(ChunkLODState& state, size_t count);
+void set_chunk_center(ChunkLODState& state, size_t index, float const* center);
+
+// Transforms all chunk centers to worldspace. Does nothing and returns false if the transform is the same as last time
+bool set_chunk_transform(ChunkLODState& state, glm::mat4 const& transform);
+
+/**
+ * @param cam_pos: Pointer to a float array with 3 values with the camera position
+ */
+void calculate_chunk_distances(ChunkLODState& state, float const* cam_pos);
+// Distance between a single chunk and the camera, without storing it
+float calculate_chunk_distance(ChunkLODState const& state, size_t index, float const* cam_pos);
+
+/**
+ * Writes the distance based LOD of every chunk to target_lod. Chunks closer than near_distance get LOD 0,
+ * chunks further away than far_distance get the lowest detail LOD and everything in between is spread linearly.
+ */
+void calculate_distance_lods(ChunkLODState& state, float near_distance, float far_distance, size_t lod_count);
+
+}
+
+#endif
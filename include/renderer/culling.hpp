@@ -0,0 +1,50 @@
+#ifndef TITAN_RENDERER_CULLING_HPP_
+#define TITAN_RENDERER_CULLING_HPP_
+
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace titan::renderer {
+
+// Frustum planes stored as ax + by + cz + d, with the normals pointing inwards. The planes are not normalized,
+// this is not needed for inside/outside tests.
+struct Frustum {
+    float planes[6][4];
+};
+
+/**
+ * @param view_projection: Combined matrix to extract the planes from. Passing projection * view * model gives
+ *                         planes in the model space of the terrain, so chunk bounds don't need to be transformed.
+ */
+Frustum make_frustum(glm::mat4 const& view_projection);
+
+// Axis aligned bounding boxes stored as center + half extents in structure of arrays layout, so multiple boxes
+// can be tested with a single SIMD instruction. The arrays are padded to a multiple of 4 with empty boxes.
+struct ChunkBounds {
+    std::vector<float> center_x;
+    std::vector<float> center_y;
+    std::vector<float> center_z;
+    std::vector<float> extent_x;
+    std::vector<float> extent_y;
+    std::vector<float> extent_z;
+
+    size_t count = 0;
+};
+
+void resize_chunk_bounds(ChunkBounds& bounds, size_t count);
+void set_chunk_bounds(ChunkBounds& bounds, size_t index, float const* min, float const* max);
+
+struct CullStats {
+    size_t visible = 0;
+    size_t culled = 0;
+};
+
+/**
+ * @param visible: Receives 1 for every chunk that intersects the frustum and 0 for every chunk outside of it.
+ *                 Will be resized to bounds.count.
+ */
+CullStats cull_chunks(Frustum const& frustum, ChunkBounds const& bounds, std::vector<unsigned char>& visible);
+
+}
+
+#endif
\ No newline at end of file
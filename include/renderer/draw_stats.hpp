@@ -0,0 +1,16 @@
+#ifndef TITAN_RENDERER_DRAW_STATS_HPP_
+#define TITAN_RENDERER_DRAW_STATS_HPP_
+
+#include <cstddef>
+
+namespace titan::renderer {
+
+// What a render call submitted to the GPU
+struct DrawStats {
+    size_t draw_calls = 0;
+    size_t triangles = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef TITAN_RENDERER_FRAME_PIPELINE_HPP_
+#define TITAN_RENDERER_FRAME_PIPELINE_HPP_
+
+#include "generators/heightmap_terrain.hpp"
+
+#include "renderer/chunk_lod_state.hpp"
+#include "renderer/culling.hpp"
+#include "renderer/draw_stats.hpp"
+#include "renderer/occlusion.hpp"
+#include "renderer/terrain_renderer.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace titan::renderer {
+
+// Everything the prepare stage needs to know about a frame
+struct FrameInput {
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 projection = glm::mat4(1.0f);
+    glm::mat4 terrain_transform = glm::mat4(1.0f);
+    glm::vec3 cam_pos = glm::vec3(0.0f);
+    // Where the camera is predicted to be soon, LODs for there are prefetched
+    glm::vec3 predicted_pos = glm::vec3(0.0f);
+};
+
+// Result of the prepare stage. Only CPU data, nothing in here touches GL
+struct PreparedFrame {
+    // Input the frame was prepared for. Render with these matrices, they lag one frame behind the latest input
+    FrameInput input;
+
+    std::vector<unsigned char> visible;
+    CullStats cull_stats;
+    OcclusionStats occlusion_stats;
+
+    // Worldspace distance of every chunk to the camera
+    std::vector<float> distance;
+    // LOD every chunk should move to, TerrainRenderInfo::no_lod for chunks that are not visible
+    std::vector<size_t> target_lods;
+    // LOD every chunk needs at predicted_pos, TerrainRenderInfo::no_lod if that is the LOD it already has
+    std::vector<size_t> prefetch_lods;
+    // Triangles handed out when using a triangle budget
+    size_t budget_triangles = 0;
+
+    // Visible chunks sorted front to back, so the depth test rejects as much as possible
+    std::vector<std::uint32_t> draw_list;
+};
+
+// Splits the terrain part of a frame in a CPU only prepare stage and a GL submit stage. Culling, LOD selection and
+// building the draw list for frame N + 1 run on a worker thread while the GL thread submits frame N, so the rendered
+// frame is always one frame behind the latest input.
+struct FramePipeline {
+    FramePipeline() = default;
+    // The worker holds a pointer to the pipeline, so it can't be copied or moved
+    FramePipeline(FramePipeline const&) = delete;
+    FramePipeline& operator=(FramePipeline const&) = delete;
+    // Stops the worker like destroy_frame_pipeline, so unwinding past a running pipeline doesn't terminate the program
+    ~FramePipeline();
+
+    HeightmapTerrain const* terrain = nullptr;
+    TerrainRenderInfo const* info = nullptr;
+
+    LODSelectionParams lod_selection;
+    // When non-zero, LODs are handed out from this triangle budget instead of picked per chunk
+    size_t triangle_budget = 0;
+
+    // Owned by the worker while a frame is being prepared
+    ChunkLODState lod_state;
+    HorizonOccluder occluder;
+    // LOD every chunk had when the frame was handed to the worker. The worker can't read the LOD buffers,
+    // the GL thread changes them while it runs
+    std::vector<size_t> current_lods;
+
+    // Two frames, the worker writes one while the GL thread submits the other
+    PreparedFrame frames[2];
+    // Frame the worker writes next
+    size_t next_frame = 0;
+    // Input of the frame the worker is preparing
+    FrameInput input;
+    bool started = false;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable cv;
+    // Whether the worker has a frame to prepare, or is preparing one
+    bool busy = false;
+    bool quit = false;
+};
+
+/**
+ * Starts the worker thread. info and terrain must outlive the pipeline, and info must not be moved.
+ * @param triangle_budget: Use allocate_triangle_budget instead of lod_from_screen_space_error when non-zero
+ */
+void create_frame_pipeline(FramePipeline& pipeline, TerrainRenderInfo const& info, HeightmapTerrain const& terrain,
+                           LODSelectionParams const& lod_selection, size_t triangle_budget = 0);
+// Stops the worker thread. Afterwards the pipeline can be created again, for example for a new terrain
+void destroy_frame_pipeline(FramePipeline& pipeline);
+
+/**
+ * Waits for the frame that is being prepared, and starts preparing input on the worker. Must be called from the GL
+ * thread, since it reads the current LODs from info. The first call prepares input on the calling thread instead.
+ * @return The finished frame, valid until the next call
+ */
+PreparedFrame const& advance_frame_pipeline(FramePipeline& pipeline, TerrainRenderInfo const& info, FrameInput const& input);
+
+/**
+ * Submit stage. Applies the LODs picked for frame, and draws its draw list. The same uniforms as render_terrain
+ * must be set up first, with the matrices from frame.input.
+ */
+DrawStats submit_prepared_frame(TerrainRenderInfo& info, HeightmapTerrain const& terrain, PreparedFrame const& frame);
+
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef TITAN_RENDERER_GL_RESOURCE_HPP_
+#define TITAN_RENDERER_GL_RESOURCE_HPP_
+
+#include <cstddef>
+#include <utility>
+
+namespace titan::renderer {
+
+enum class GLObjectType {
+    Buffer,
+    Texture,
+    VertexArray
+};
+
+// Deletes GL objects once the GPU is done with them. Objects queued during a frame are fenced in end_frame(), and
+// deleted in a later end_frame() once that fence signalled. That way we never delete something a frame in flight still
+// reads from, which would make the driver either stall or keep its own copy alive.
+// Like the rest of the renderer, this may only be used from the thread owning the GL context.
+class DeletionQueue {
+public:
+    // Queues an object for deletion. Ignores 0
+    static void push(GLObjectType type, unsigned int name);
+    // Fences everything queued since the last call, and deletes the objects of earlier frames that the GPU is done with.
+    // Call once per frame, after submitting all draws of the frame
+    static void end_frame();
+    // Waits for the GPU and deletes everything in the queue. Call before destroying the context
+    static void flush();
+
+    // Objects waiting to be deleted
+    static size_t pending();
+    // Objects deleted since the start of the program
+    static size_t deleted();
+};
+
+// Owns a GL object and queues it in the DeletionQueue when destroyed or reset. Move only, like the objects it owns
+template<GLObjectType Type>
+class GLObject {
+public:
+    GLObject() = default;
+    explicit GLObject(unsigned int name) : name(name) {}
+
+    GLObject(GLObject&& rhs) : name(std::exchange(rhs.name, 0)) {}
+    GLObject& operator=(GLObject&& rhs) {
+        if (this != &rhs) {
+            reset(std::exchange(rhs.name, 0));
+        }
+        return *this;
+    }
+
+    GLObject(GLObject const&) = delete;
+    GLObject& operator=(GLObject const&) = delete;
+
+    ~GLObject() {
+        reset();
+    }
+
+    unsigned int get() const {
+        return name;
+    }
+
+    explicit operator bool() const {
+        return name != 0;
+    }
+
+    // Queues the current object for deletion and takes ownership of new_name
+    void reset(unsigned int new_name = 0) {
+        DeletionQueue::push(Type, name);
+        name = new_name;
+    }
+
+    // Gives up ownership without deleting the object
+    unsigned int release() {
+        return std::exchange(name, 0);
+    }
+
+private:
+    unsigned int name = 0;
+};
+
+using GLBuffer = GLObject<GLObjectType::Buffer>;
+using GLTexture = GLObject<GLObjectType::Texture>;
+using GLVertexArray = GLObject<GLObjectType::VertexArray>;
+
+// Create a new object with DSA, so it is initialized without binding it
+GLBuffer make_buffer();
+GLTexture make_texture(unsigned int target);
+GLVertexArray make_vertex_array();
+
+}
+
+#endif
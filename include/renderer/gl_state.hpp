@@ -0,0 +1,40 @@
+#ifndef TITAN_RENDERER_GL_STATE_HPP_
+#define TITAN_RENDERER_GL_STATE_HPP_
+
+#include <cstddef>
+
+namespace titan::renderer {
+
+// Tracks the GL binding state the renderer changes every frame, and skips binds that wouldn't change anything. Only
+// works if all of these binds go through here, objects are created and edited with DSA so they never need binding.
+// Like the rest of the renderer, this may only be used from the thread owning the GL context.
+class GLStateCache {
+public:
+    struct Counters {
+        // State changes that were passed on to GL
+        size_t issued = 0;
+        // State changes that were skipped because the state was already set
+        size_t skipped = 0;
+    };
+
+    static void use_program(unsigned int program);
+    static void bind_vertex_array(unsigned int vao);
+    static void bind_texture_unit(unsigned int unit, unsigned int texture);
+    // Vertex and element buffer bindings are part of the VAO, so they are tracked per VAO and set with DSA
+    static void vertex_buffer(unsigned int vao, unsigned int binding, unsigned int buffer, size_t offset, size_t stride);
+    static void element_buffer(unsigned int vao, unsigned int buffer);
+
+    // Call before deleting an object, so a new object that gets the same name isn't mistaken for it
+    static void forget_texture(unsigned int texture);
+    static void forget_buffer(unsigned int buffer);
+    static void forget_vertex_array(unsigned int vao);
+    // Forgets all tracked state. Call after changing any of it without going through this class
+    static void invalidate();
+
+    // Totals since the start of the program, diff them to get the counts for a frame
+    static Counters counters();
+};
+
+}
+
+#endif
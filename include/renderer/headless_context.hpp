@@ -0,0 +1,30 @@
+#ifndef TITAN_RENDERER_HEADLESS_CONTEXT_HPP_
+#define TITAN_RENDERER_HEADLESS_CONTEXT_HPP_
+
+#include <cstddef>
+
+namespace titan::renderer {
+
+// OpenGL 4.5 context without a window, created through EGL on a surfaceless display (for example Mesa's llvmpipe).
+// There is no default framebuffer, so rendering goes to an offscreen framebuffer of the requested size.
+struct HeadlessContext {
+    // EGLDisplay and EGLContext
+    void* display = nullptr;
+    void* context = nullptr;
+
+    unsigned int framebuffer = 0;
+    unsigned int color_buffer = 0;
+    unsigned int depth_buffer = 0;
+
+    size_t width = 0;
+    size_t height = 0;
+};
+
+// Creates the context, makes it current, loads GL functions and binds the offscreen framebuffer. 
+// Throws if EGL is not available or Titan was built without TITAN_HEADLESS.
+HeadlessContext create_headless_context(size_t width, size_t height);
+void destroy_headless_context(HeadlessContext& context);
+
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef TITAN_RENDERER_INSTANCED_TERRAIN_RENDERER_HPP_
+#define TITAN_RENDERER_INSTANCED_TERRAIN_RENDERER_HPP_
+
+#include "generators/heightmap_terrain.hpp"
+
+#include "renderer/culling.hpp"
+#include "renderer/chunk_lod_state.hpp"
+#include "renderer/occlusion.hpp"
+#include "renderer/draw_stats.hpp"
+#include "renderer/gl_resource.hpp"
+#include "renderer/util.hpp"
+#include "renderer/virtual_heightmap.hpp"
+
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace titan::renderer {
+
+// Alternative to TerrainRenderInfo. The vertex shader already displaces every vertex with the heightmap, so instead of
+// uploading a translated copy of the grid for every chunk we keep one patch mesh per LOD and draw all chunks
+// with the same LOD in one instanced draw call. Geometry memory does not depend on the size of the world anymore.
+// Requires the instanced_grid.vert shader.
+struct InstancedTerrainRenderInfo {
+    GLVertexArray vao;
+
+    struct PatchMesh {
+        GLBuffer vbo;
+        GLBuffer ebo;
+        size_t elements = 0;
+    };
+
+    // Per-instance data, this is the layout of the instance buffer
+    struct InstanceData {
+        float offset[2];
+        float lod;
+    };
+
+    // One patch mesh for each LOD. Index 0 is the highest detail patch
+    std::vector<PatchMesh> patches;
+
+    // Holds one InstanceData for every chunk, sorted by LOD
+    GLBuffer instance_buffer;
+    std::vector<InstanceData> instances;
+    // Size of the instance data uploaded by the last LOD update
+    size_t uploaded_bytes = 0;
+    // Offset of the first instance and instance count for each LOD
+    std::vector<size_t> lod_first_instance;
+    std::vector<size_t> lod_instance_count;
+
+    // Chunk data. Offsets are stored as 2 floats per chunk
+    std::vector<size_t> chunk_lods;
+    ChunkLODState lod_state;
+    std::vector<float> chunk_offsets;
+
+    // Culling data, see TerrainRenderInfo. Culled chunks are left out of the instance buffer
+    ChunkBounds bounds;
+    std::vector<unsigned char> visible;
+    CullStats cull_stats;
+
+    std::vector<HeightfieldBox> occluder_boxes;
+    HorizonOccluder occluder;
+    OcclusionStats occlusion_stats;
+
+    // Heightmap texture, with a mip chain. See TerrainRenderInfo
+    GLTexture height_map;
+    VirtualHeightmap virtual_height_map;
+    float height_map_base_level = 0;
+    float chunk_size = 0;
+};
+
+InstancedTerrainRenderInfo make_instanced_terrain_render_info(HeightmapTerrain const& terrain, size_t const initial_lod,
+                                                              HeightmapFormat heightmap_format = HeightmapFormat::R16,
+                                                              VirtualHeightmapInfo const* virtual_heightmap = nullptr);
+
+// Picks a new LOD for every chunk and rebuilds the instance buffer
+void update_lod_distance(InstancedTerrainRenderInfo& info, HeightmapTerrain const& terrain, glm::mat4 terrain_transform, float const* cam_pos);
+
+/**
+ * @param view_projection: projection * view * terrain_transform
+ */
+void cull_terrain(InstancedTerrainRenderInfo& info, glm::mat4 const& view_projection);
+// Same as the TerrainRenderInfo versions
+void occlusion_cull_terrain(InstancedTerrainRenderInfo& info, glm::mat4 const& terrain_transform, float const* cam_pos);
+void update_height_map_pages(InstancedTerrainRenderInfo& info, HeightmapTerrain const& terrain, glm::mat4 const& terrain_transform, float const* cam_pos);
+
+// Before calling this, the instanced_grid shader must be bound. Sets uniforms 9 and 11 like the TerrainRenderInfo
+// version, the LOD comes from the instance data
+DrawStats render_terrain(InstancedTerrainRenderInfo const& terrain);
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef TITAN_RENDERER_LOD_SCHEDULE_HPP_
+#define TITAN_RENDERER_LOD_SCHEDULE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace titan::renderer {
+
+// Decides which chunks need their LOD re-evaluated. Every chunk gets a slack: how far the camera can move before
+// the chunk's LOD could change. Since the distance to a chunk can't change faster than the camera moves, a chunk only
+// needs to be looked at again once the total distance the camera travelled (the odometer) passes the odometer at its
+// last evaluation plus its slack. Chunks are kept in buckets by that deadline, so a frame only visits the buckets
+// the odometer moved past.
+struct LODSchedule {
+    static constexpr size_t not_scheduled = static_cast<size_t>(-1);
+
+    // Odometer distance covered by a single bucket
+    float bucket_width = 1.0f;
+    // Total distance the camera moved
+    double odometer = 0;
+    float last_cam[3] = {0, 0, 0};
+    bool has_camera = false;
+
+    // Ring of buckets, bucket k is stored at k % buckets.size(). Slack further ahead than the ring covers is clamped,
+    // those chunks are simply re-evaluated early.
+    std::vector<std::vector<std::uint32_t>> buckets;
+    // Last bucket that was drained
+    size_t drained_bucket = 0;
+    // Bucket every chunk is waiting in, used to skip stale entries
+    std::vector<size_t> chunk_bucket;
+    // Chunks to re-evaluate next frame no matter how far the camera moves, for example because they are still
+    // moving towards their target LOD
+    std::vector<std::uint32_t> pending;
+
+    // Chunks to re-evaluate this frame, filled by advance_lod_schedule
+    std::vector<std::uint32_t> due;
+    std::vector<unsigned char> is_due;
+
+    // Visibility at the last update, chunks that come into view are always re-evaluated
+    std::vector<unsigned char> was_visible;
+};
+
+void create_lod_schedule(LODSchedule& schedule, size_t chunk_count, float bucket_width, size_t bucket_count = 256);
+// Marks every chunk as due, for example because the terrain transform changed
+void reset_lod_schedule(LODSchedule& schedule);
+
+/**
+ * Adds the camera movement since the last call to the odometer and fills schedule.due with every chunk whose slack
+ * may have been used up.
+ * @param cam_pos: Pointer to a float array with 3 values with the camera position
+ */
+void advance_lod_schedule(LODSchedule& schedule, float const* cam_pos);
+
+// Adds a chunk to schedule.due, if it isn't in there yet
+void mark_chunk_due(LODSchedule& schedule, std::uint32_t chunk_id);
+
+// Schedules the next evaluation of a chunk. A slack of 0 re-evaluates the chunk next frame
+void schedule_chunk(LODSchedule& schedule, std::uint32_t chunk_id, float slack);
+
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef TITAN_RENDERER_OCCLUSION_HPP_
+#define TITAN_RENDERER_OCCLUSION_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace titan::renderer {
+
+// Footprint of a chunk on the ground plane and the range of its surface heights. Any space works, as long as
+// the camera position passed to occlude_chunks uses the same one.
+struct HeightfieldBox {
+    float min_x;
+    float min_y;
+    float max_x;
+    float max_y;
+    float min_height;
+    float max_height;
+};
+
+// 1D horizon around the camera. Every bin covers a slice of directions on the ground plane and stores the
+// steepest elevation slope (height difference / distance) of terrain that is known to block everything behind it.
+struct HorizonOccluder {
+    // Amount of directions the horizon is split into
+    size_t resolution = 1024;
+    std::vector<float> horizon;
+
+    // Scratch data, kept around to avoid allocating every frame
+    std::vector<std::uint32_t> order;
+    std::vector<float> distances;
+};
+
+struct OcclusionStats {
+    size_t tested = 0;
+    size_t occluded = 0;
+};
+
+/**
+ * Walks all chunks front to back, growing the horizon with the lowest surface of every chunk. Chunks whose highest
+ * point is below the horizon in all directions they cover are hidden behind terrain closer to the camera. 
+ * Runs on the CPU only and does not touch any GL state.
+ * @param cam: Pointer to 3 floats with the camera position as x, y on the ground plane and height
+ * @param visible: Only chunks marked visible are tested, and occluded chunks are set to 0. All chunks are used as occluders.
+ */
+OcclusionStats occlude_chunks(HorizonOccluder& occluder, std::vector<HeightfieldBox> const& boxes, float const* cam, 
+                              std::vector<unsigned char>& visible);
+
+}
+
+#endif
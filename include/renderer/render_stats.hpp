@@ -0,0 +1,79 @@
+#ifndef TITAN_RENDERER_RENDER_STATS_HPP_
+#define TITAN_RENDERER_RENDER_STATS_HPP_
+
+#include "renderer/draw_stats.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace titan::renderer {
+
+struct TerrainRenderInfo;
+struct InstancedTerrainRenderInfo;
+
+// Ring of the last samples of a value, to get percentiles over a recent window of frames
+struct RollingStat {
+    std::vector<float> samples;
+    size_t next = 0;
+    size_t count = 0;
+};
+
+void add_sample(RollingStat& stat, float value);
+/**
+ * @param p: Percentile between 0 and 1, for example 0.99 for p99
+ * @return 0 if there are no samples yet
+ */
+float percentile(RollingStat const& stat, float p);
+
+// Live numbers of the terrain renderer, filled every frame between begin_render_stats and end_render_stats
+struct RenderStats {
+    // Last frame. gpu_ms lags a few frames behind, since timer queries are read back without waiting for the GPU
+    float cpu_ms = 0;
+    float gpu_ms = 0;
+    DrawStats draw;
+    size_t uploaded_bytes = 0;
+    // Time spent blocked in SwapBuffer::wait_for_upload
+    float upload_stall_ms = 0;
+    // Amount of drawn chunks for every LOD
+    std::vector<size_t> chunks_per_lod;
+    // Binds that went through GLStateCache, and how many of them were skipped as redundant
+    size_t state_changes = 0;
+    size_t skipped_state_changes = 0;
+
+    RollingStat cpu_ms_history;
+    RollingStat gpu_ms_history;
+    RollingStat upload_stall_history;
+
+    // GL_TIME_ELAPSED queries, one is started every frame and read back once the GPU finished it
+    std::vector<unsigned int> queries;
+    std::vector<unsigned char> query_pending;
+    // Whether a query was started this frame. It isn't when the oldest query still had no result
+    bool query_active = false;
+    size_t frame = 0;
+
+    std::uint64_t frame_start_ns = 0;
+    std::uint64_t stall_start_ns = 0;
+    size_t state_changes_start = 0;
+    size_t skipped_state_changes_start = 0;
+};
+
+/**
+ * @param window: Amount of frames the percentiles are calculated over
+ */
+void create_render_stats(RenderStats& stats, size_t window = 240);
+void destroy_render_stats(RenderStats& stats);
+
+// Call at the start of the frame, before the LOD update so it counts towards the CPU time
+void begin_render_stats(RenderStats& stats);
+// Call after render_terrain, with the stats it returned
+void end_render_stats(RenderStats& stats, TerrainRenderInfo const& info, DrawStats const& draw);
+void end_render_stats(RenderStats& stats, InstancedTerrainRenderInfo const& info, DrawStats const& draw);
+
+// Writes a human readable summary with p50/p99 times, for logging or an overlay
+void print_render_stats(std::ostream& out, RenderStats const& stats);
+
+}
+
+#endif
@@ -1,7 +1,11 @@
 #ifndef TITAN_TERRAIN_RENDERER_SWAP_BUFFER_HPP_
 #define TITAN_TERRAIN_RENDERER_SWAP_BUFFER_HPP_
 
-#include <thread>
+#include "renderer/gl_resource.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
 
 namespace titan::renderer {
 
@@ -12,31 +16,61 @@ public:
 
     SwapBuffer& operator=(SwapBuffer&&);
 
+    // Creates a buffer owned by this SwapBuffer. It is deleted through the DeletionQueue once the SwapBuffer is destroyed
     void create(unsigned int buffer_target, size_t max_byte_size);
+    // Uses a range of an existing persistently mapped buffer instead of creating a new one. The buffer is not owned,
+    // it has to outlive the view. mapped_ptr must point to the start of the range.
+    void create_view(unsigned int buffer_target, unsigned int buffer, size_t byte_offset, size_t max_byte_size, void* mapped_ptr);
 
     ~SwapBuffer();
 
     unsigned int get() const;
+    // Offset of the data in the buffer returned by get(), in bytes
+    size_t offset() const;
 
     size_t current_size() const;
     size_t max_size() const;
 
-    // The data pointer must be valid for the entire duration of the data upload, e.g. until wait_for_upload() is called
+    // The data pointer must be valid for the entire duration of the data upload, e.g. until poll_upload() returns true
+    // or wait_for_upload() is called. The copy is done by the UploadPool workers.
     void start_data_upload(void const* data, size_t len);
+    // Never blocks. Flushes the data once the copy is done and returns true once the GPU has received it.
+    // Must be called from the thread owning the GL context
+    bool poll_upload();
     // This function does not return until the data upload is complete, and then flushes the changes to the GPU
     void wait_for_upload();
 
+    // Total time all SwapBuffers spent blocked in wait_for_upload, in nanoseconds
+    static std::uint64_t stall_nanoseconds();
+
     void swap(SwapBuffer& other);
 
 private:
+    enum class UploadState {
+        Idle,
+        // Waiting for a worker to finish the copy
+        Copying,
+        // Copy is flushed, waiting for the fence
+        Fenced
+    };
+
+    void flush();
+
     unsigned int target = 0;
     unsigned int handle = 0;
+    // Holds handle if it was created by this SwapBuffer, empty for views
+    GLBuffer storage;
+    size_t byte_offset = 0;
     size_t size = 0;
 
     void* mapped_data = nullptr;
     size_t cur_write_length = 0;
 
-    std::thread worker;
+    UploadState state = UploadState::Idle;
+    // Heap allocated so the workers can keep pointing to it when the SwapBuffer is moved or swapped
+    std::unique_ptr<std::atomic<bool>> copy_done = std::make_unique<std::atomic<bool>>(true);
+    // GLsync, we don't want to include glad in this header
+    void* fence = nullptr;
 };
 
 }
@@ -0,0 +1,112 @@
+#ifndef TITAN_RENDERER_TERRAIN_HANDLE_HPP_
+#define TITAN_RENDERER_TERRAIN_HANDLE_HPP_
+
+#include "generators/heightmap_terrain.hpp"
+
+#include "renderer/terrain_renderer.hpp"
+#include "renderer/util.hpp"
+#include "renderer/virtual_heightmap.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <thread>
+
+namespace titan::renderer {
+
+struct TerrainHandleInfo {
+    // See make_terrain_render_info. Every terrain starts at its middle LOD
+    size_t residency_budget = 256 * 1024 * 1024;
+    HeightmapFormat heightmap_format = HeightmapFormat::R16;
+    // Not owned, must outlive the handle when set
+    VirtualHeightmapInfo const* virtual_heightmap = nullptr;
+    // Bytes of heightmap texels or chunk data a rebuild uploads per frame
+    size_t upload_budget = 8 * 1024 * 1024;
+};
+
+// A terrain and everything needed to render it
+struct TerrainSlot {
+    HeightmapTerrainInfo info;
+    HeightmapTerrain terrain;
+    TerrainRenderInfo render_info;
+};
+
+// Double buffered terrain, so parameters can be changed without a hitch. The active terrain keeps rendering while the
+// rebuilt one is generated on a worker thread and then uploaded a bit every frame. Once it is fully resident,
+// update_terrain_handle swaps it in at the start of a frame and the old one is released through the DeletionQueue.
+struct TerrainHandle {
+    enum class Stage {
+        Idle,
+        // The worker is generating pending->terrain
+        Generating,
+        // Uploading pending a part at a time
+        Uploading
+    };
+
+    TerrainHandle() = default;
+    // The worker points at the handle, so it can't be copied or moved
+    TerrainHandle(TerrainHandle const&) = delete;
+    TerrainHandle& operator=(TerrainHandle const&) = delete;
+    // Waits for a running worker, so a handle that is never destroyed with destroy_terrain_handle doesn't take the
+    // program down with it
+    ~TerrainHandle();
+
+    TerrainHandleInfo info;
+
+    // Terrain that is rendered. Heap allocated so pointers into it stay valid until it is swapped out
+    std::unique_ptr<TerrainSlot> active;
+    // Terrain that is being rebuilt
+    std::unique_ptr<TerrainSlot> pending;
+    // Terrain that was swapped out by the last update_terrain_handle. Kept alive until release_retired_terrain, since
+    // something like a FramePipeline worker may still be reading it
+    std::unique_ptr<TerrainSlot> retired;
+    Stage stage = Stage::Idle;
+
+    // Owned by the worker until generated is true
+    std::thread worker;
+    std::atomic<bool> generated = false;
+    // Set by the worker when generating failed, rethrown by update_terrain_handle
+    std::exception_ptr error;
+    // Heightmap texture contents of pending, or the fallback of its virtual heightmap. Built by the worker
+    HeightmapTexels texels;
+    float fallback_level_offset = 0;
+
+    // Upload progress of pending
+    HeightmapUploadCursor heightmap_cursor;
+    bool heightmap_uploaded = false;
+    bool pool_reserved = false;
+    size_t next_chunk = 0;
+
+    // Rebuild requested while another one was running. Only the latest request is kept
+    bool has_queued_rebuild = false;
+    HeightmapTerrainInfo queued_rebuild;
+
+    // Incremented every time a new terrain is swapped in
+    size_t generation = 0;
+};
+
+// Builds the first terrain right away, on the calling thread
+void create_terrain_handle(TerrainHandle& handle, HeightmapTerrainInfo const& terrain_info, TerrainHandleInfo const& info = {});
+// Waits for a running worker and releases both terrains
+void destroy_terrain_handle(TerrainHandle& handle);
+
+// Never blocks. When a rebuild is already running this one starts after it, replacing any earlier queued request
+void request_terrain_rebuild(TerrainHandle& handle, HeightmapTerrainInfo const& terrain_info);
+
+/**
+ * Advances a running rebuild, and swaps the new terrain in once all of it is resident. Call once per frame from the
+ * GL thread, before anything reads handle.active for that frame.
+ * @return true when active was replaced. The old terrain is moved to handle.retired. Stop everything that points into
+ *         it, like a FramePipeline, then call release_retired_terrain
+ * @throws Whatever generating the terrain threw on the worker. The rebuild is dropped and active stays as it was
+ */
+bool update_terrain_handle(TerrainHandle& handle);
+// Frees the terrain swapped out by update_terrain_handle. Its GL objects go through the DeletionQueue
+void release_retired_terrain(TerrainHandle& handle);
+
+bool terrain_rebuild_running(TerrainHandle const& handle);
+
+}
+
+#endif
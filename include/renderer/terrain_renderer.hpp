@@ -3,7 +3,16 @@
 
 #include "generators/heightmap_terrain.hpp"
 
+#include "renderer/gl_resource.hpp"
 #include "renderer/swap_buffer.hpp"
+#include "renderer/buffer_pool.hpp"
+#include "renderer/culling.hpp"
+#include "renderer/chunk_lod_state.hpp"
+#include "renderer/lod_schedule.hpp"
+#include "renderer/occlusion.hpp"
+#include "renderer/draw_stats.hpp"
+#include "renderer/util.hpp"
+#include "renderer/virtual_heightmap.hpp"
 
 #include <vector>
 #include <glm/glm.hpp>
@@ -12,15 +21,24 @@ namespace titan::renderer {
 
 struct TerrainRenderInfo {
     // We can use one single vao because the vertex format is consistent for each chunk
-    unsigned int vao;
+    GLVertexArray vao;
 
 
+    // Value of LODBuffer::lod for a buffer that holds no data, for example because it was evicted
+    static constexpr size_t no_lod = static_cast<size_t>(-1);
+
     struct LODBuffer {
+        // Views into the pool block in allocation. Vertices first, then indices
         SwapBuffer vbo;
         SwapBuffer ebo;
-        size_t elements;
+        size_t elements = 0;
 
-        size_t lod;
+        size_t lod = no_lod;
+        BufferPool::Allocation allocation;
+        // LOD waiting in upload_requests to be loaded into this buffer
+        size_t requested_lod = no_lod;
+        // Whether lod was loaded by prefetch_lods and not used yet
+        bool prefetched = false;
     };
 
     struct ChunkRenderInfo {
@@ -28,38 +46,226 @@ struct TerrainRenderInfo {
         LODBuffer current_lod;
         LODBuffer higher_lod;
         LODBuffer lower_lod;  
-
-        float center[3] = {0, 0, 0};
     };
 
     std::vector<ChunkRenderInfo> chunks;
+    // Centers, camera distances and LODs of all chunks. The distances are also used to prioritize uploads and evictions
+    ChunkLODState lod_state;
+    // Chunks that update_lod_distance has to look at this frame. Distances of the other chunks are not updated
+    LODSchedule lod_schedule;
+
+    struct UploadRequest {
+        size_t chunk_id;
+        // Whether the upload goes to lower_lod or higher_lod
+        bool lower;
+        size_t lod;
+        bool prefetch = false;
+    };
+
+    // Uploads that didn't fit in the per frame budget yet. Processed nearest chunk first
+    std::vector<UploadRequest> upload_requests;
+    // Maximum amount of bytes uploaded per frame. At least one upload is always started per frame, even when
+    // it is larger than the budget
+    size_t upload_budget = 8 * 1024 * 1024;
+    // Amount of bytes uploads were started for during the last LOD update
+    size_t uploaded_bytes = 0;
+
+    struct PrefetchStats {
+        // Uploads requested by prefetch_lods
+        size_t issued = 0;
+        // LOD switches that used a prefetched LOD
+        size_t hits = 0;
+        // LOD switches that had to wait for the LOD to be uploaded first
+        size_t misses = 0;
+    };
+
+    PrefetchStats prefetch_stats;
+
+    // Every LOD buffer is a block in this pool, with one size class per LOD
+    BufferPool buffer_pool;
+
+    // Bounding boxes of all chunks in terrain space
+    ChunkBounds bounds;
+    // Result of the last cull_terrain call, 1 for every chunk that is in view. Culled chunks are not drawn
+    // and don't get LOD updates.
+    std::vector<unsigned char> visible;
+    CullStats cull_stats;
+
+    // Footprints and height ranges of all chunks for occlusion culling, see occlusion_cull_terrain
+    std::vector<HeightfieldBox> occluder_boxes;
+    HorizonOccluder occluder;
+    OcclusionStats occlusion_stats;
+
+    // LODs picked by the last update_lod_triangle_budget call, and the amount of triangles they add up to.
+    // Chunks keep drawing their current LOD until the target LOD is uploaded
+    std::vector<size_t> target_lods;
+    size_t budget_triangles = 0;
 
-    // Heightmap texture
-    unsigned int height_map;
+    // Heightmap texture, with a mip chain. Empty when virtual_height_map is used instead
+    GLTexture height_map;
+    VirtualHeightmap virtual_height_map;
+    // See heightmap_base_mip_level
+    float height_map_base_level = 0;
+    float chunk_size = 0;
 
     // Misc data
     size_t vertex_size;
 };
 
-TerrainRenderInfo make_terrain_render_info(HeightmapTerrain const& terrain, size_t const initial_lod);
+// Parameters for picking LODs by their projected geometric error
+struct LODSelectionParams {
+    // Maximum error a LOD may have on screen, in pixels
+    float pixel_error = 2.0f;
+    // A lower detail LOD is only picked once its error is below pixel_error * (1 - hysteresis), so chunks
+    // close to the threshold don't switch back and forth every frame
+    float hysteresis = 0.25f;
+    // Converts worldspace error / distance to pixels. Use make_lod_selection_params to calculate this
+    float error_scale = 1.0f;
+};
+
+LODSelectionParams make_lod_selection_params(glm::mat4 const& projection, float viewport_height, 
+                                             float pixel_error = 2.0f, float hysteresis = 0.25f);
+
+// Fills bounds with the terrain space bounding boxes of all chunks
+void make_chunk_bounds(ChunkBounds& bounds, HeightmapTerrain const& terrain);
+
+// Fills boxes with the terrain space footprints and height ranges of all chunks. Heights are measured along -z,
+// which is the direction the vertex shader displaces higher terrain in
+void make_occluder_boxes(std::vector<HeightfieldBox>& boxes, HeightmapTerrain const& terrain);
+
+/**
+ * @param residency_budget: Amount of bytes the chunk buffers may use before the neighbour LODs of far away chunks are evicted.
+ * @param heightmap_format: R32F is only needed when the 1 / 65535 height steps of R16 are visible
+ * @param virtual_heightmap: Streams the heightmap in pages instead of creating one texture for all of it, see VirtualHeightmap.
+ *                           Call update_height_map_pages every frame when using this.
+ */
+TerrainRenderInfo make_terrain_render_info(HeightmapTerrain const& terrain, size_t const initial_lod,
+                                           size_t const residency_budget = 256 * 1024 * 1024,
+                                           HeightmapFormat heightmap_format = HeightmapFormat::R16,
+                                           VirtualHeightmapInfo const* virtual_heightmap = nullptr);
 
-void higher_lod(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t chunk_id);
-void lower_lod(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t chunk_id);
+/**
+ * First half of make_terrain_render_info, for building a terrain over several frames. Sets up everything except the
+ * heightmap and the chunk buffers. Create either height_map or virtual_height_map, see create_virtual_heightmap_deferred,
+ * and start the chunk uploads with upload_initial_lods. Chunks are drawn from empty buffers until then.
+ */
+TerrainRenderInfo make_terrain_render_info_deferred(HeightmapTerrain const& terrain, size_t const initial_lod,
+                                                    size_t const residency_budget = 256 * 1024 * 1024);
+
+// Creates the pool slabs upload_initial_lods will need, at most one per call. Returns true once all of them exist
+bool reserve_initial_lods(TerrainRenderInfo& info, HeightmapTerrain const& terrain);
+
+/**
+ * Starts uploading the initial LOD and its neighbours for the chunks from first_chunk on, until about max_bytes are queued.
+ * At least one chunk is queued per call.
+ * @return The first chunk that wasn't queued yet, chunks.size() once every chunk is
+ */
+size_t upload_initial_lods(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t first_chunk, size_t max_bytes);
 
+// Heightmap mip level that matches the vertex spacing of LOD 0. Every next LOD halves the vertex density, so LOD n
+// samples level base + n. Negative when LOD 0 has more vertices than the heightmap has texels, the shaders clamp to 0
+float heightmap_base_mip_level(HeightmapTerrain const& terrain);
+
+// These never block. They return false without changing anything when the neighbouring LOD isn't fully
+// uploaded yet. After switching, the freed neighbour buffer is refilled through the upload queue.
+bool higher_lod(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t chunk_id);
+bool lower_lod(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t chunk_id);
+
+// Treshold for maximum LOD
+inline constexpr float lod_near_distance = 5.0f;
+// Treshold for minimum LOD
+inline constexpr float lod_far_distance = 200.0f;
+
+// Maps a distance to the camera to the LOD that should be displayed at that distance
+size_t lod_from_distance(HeightmapTerrain const& terrain, float distance);
+
+// Moves every visible chunk one LOD towards the LOD for its distance once that LOD is resident, then starts
+// queued uploads within upload_budget. Only chunks that the camera moved far enough to possibly change LOD
+// and chunks that just came into view are evaluated.
 // TODO: I don't like having glm::mat4 here but okay
 void update_lod_distance(TerrainRenderInfo& info, HeightmapTerrain const& terrain, glm::mat4 terrain_transform, float const* cam_pos);
 
+// Picks the lowest detail LOD whose error projects to at most params.pixel_error pixels
+size_t lod_from_screen_space_error(HeightmapTerrain::Chunk const& chunk, float distance, size_t current_lod, LODSelectionParams const& params);
+
+// Like update_lod_distance, but picks LODs by screen space error and goes straight to the target LOD
+// instead of stepping one LOD per frame
+void update_lod_screen_space_error(TerrainRenderInfo& info, HeightmapTerrain const& terrain, glm::mat4 terrain_transform, 
+                                   float const* cam_pos, LODSelectionParams const& params);
+
+/**
+ * Hands out LODs for all visible chunks so their total triangle count stays within triangle_budget. Every chunk starts
+ * at the lowest detail LOD, after which the refinements with the largest reduction in screen space error per added
+ * triangle are applied first. Chunks whose error is already below params.pixel_error are not refined further.
+ * @param target_lods: Receives the LOD for every chunk, or TerrainRenderInfo::no_lod for culled chunks
+ * @return The amount of triangles used
+ */
+size_t allocate_triangle_budget(TerrainRenderInfo const& info, HeightmapTerrain const& terrain, size_t triangle_budget, 
+                                LODSelectionParams const& params, std::vector<size_t>& target_lods);
+// Same as above, with the visibility and chunk distances passed in instead of read from a TerrainRenderInfo
+size_t allocate_triangle_budget(HeightmapTerrain const& terrain, std::vector<unsigned char> const& visible, 
+                                std::vector<float> const& distances, size_t triangle_budget, LODSelectionParams const& params, 
+                                std::vector<size_t>& target_lods);
+
+// Like update_lod_screen_space_error, but the LODs come from allocate_triangle_budget so the triangle count
+// stays roughly constant while the camera moves
+void update_lod_triangle_budget(TerrainRenderInfo& info, HeightmapTerrain const& terrain, glm::mat4 terrain_transform, 
+                                float const* cam_pos, size_t triangle_budget, LODSelectionParams const& params);
+
+/**
+ * @param distance: Worldspace distance between the chunk's center and the camera
+ */
+void update_lod_distance(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t chunk_id, float distance);
+
 /**
- * @param chunk_center: Pointer to a float array with 3 values with the chunk's center
+ * Requests the LODs that chunks will need once the camera reaches predicted_pos, so they are already resident when the
+ * camera gets there. Uses screen space error selection. Only visible chunks that are not changing LOD are prefetched
+ * for, and the uploads share upload_budget with the regular LOD updates. Call after the LOD update of this frame.
+ * @param predicted_pos: Pointer to a float array with 3 values with the predicted camera position
+ */
+void prefetch_lods(TerrainRenderInfo& info, HeightmapTerrain const& terrain, float const* predicted_pos, LODSelectionParams const& params);
+
+/**
+ * GL thread half of a LOD update whose LODs were already picked somewhere else, for example by a FramePipeline worker.
+ * Moves every chunk to its target LOD, requests the prefetch LODs and starts queued uploads. Polling and flushing
+ * the uploads needs the GL context, so this can't be moved to the worker.
+ * @param distances: Worldspace distance of every chunk to the camera, used to order uploads and evictions
+ * @param target_lods: LOD for every chunk, TerrainRenderInfo::no_lod for chunks that are not visible
+ * @param prefetch_lods: LOD every chunk is predicted to need soon, or TerrainRenderInfo::no_lod. May be empty
+ */
+void apply_lod_targets(TerrainRenderInfo& info, HeightmapTerrain const& terrain, std::vector<float> const& distances,
+                       std::vector<size_t> const& target_lods, std::vector<size_t> const& prefetch_lods);
+
+// Fraction of LOD switches that used a prefetched LOD, out of all switches that needed an upload
+float prefetch_hit_rate(TerrainRenderInfo::PrefetchStats const& stats);
+
+/**
+ * @param view_projection: projection * view * terrain_transform
+ */
+void cull_terrain(TerrainRenderInfo& info, glm::mat4 const& view_projection);
+
+/**
+ * Hides chunks that are behind other terrain as seen from the camera. Call after cull_terrain, this only removes
+ * chunks from info.visible. Runs on the CPU without any GL calls.
  * @param cam_pos: Pointer to a float array with 3 values with the camera position 
  */
-void update_lod_distance(TerrainRenderInfo& info, HeightmapTerrain const& terrain, 
-                         size_t chunk_id, float const* chunk_center, float const* cam_pos);
+void occlusion_cull_terrain(TerrainRenderInfo& info, glm::mat4 const& terrain_transform, float const* cam_pos);
+
+/**
+ * Streams in the heightmap pages around the camera when the terrain uses a virtual heightmap, otherwise does nothing
+ * @param cam_pos: Pointer to a float array with 3 values with the camera position
+ */
+void update_height_map_pages(TerrainRenderInfo& info, HeightmapTerrain const& terrain, glm::mat4 const& terrain_transform, float const* cam_pos);
 
 void await_all_data_upload(TerrainRenderInfo::ChunkRenderInfo& chunk);
+// Non-blocking version of await_all_data_upload, returns true once all LOD buffers of the chunk are uploaded
+bool poll_all_data_upload(TerrainRenderInfo::ChunkRenderInfo& chunk);
 
-// Before calling this, a shader must be bound
-void render_terrain(TerrainRenderInfo const& terrain);
+// Before calling this, a shader must be bound. Sets the heightmap mip uniforms: 9 (base level), 10 (LOD of the chunk)
+// and 11 (chunk size), and the virtual heightmap uniforms (see bind_height_map)
+DrawStats render_terrain(TerrainRenderInfo const& terrain);
+// Draws the chunks in draw_list in that order, instead of all visible chunks
+DrawStats render_terrain(TerrainRenderInfo const& terrain, std::vector<std::uint32_t> const& draw_list);
     
 }
 
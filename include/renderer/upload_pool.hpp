@@ -0,0 +1,28 @@
+#ifndef TITAN_RENDERER_UPLOAD_POOL_HPP_
+#define TITAN_RENDERER_UPLOAD_POOL_HPP_
+
+#include <atomic>
+#include <cstddef>
+
+namespace titan::renderer {
+
+// Persistent pool of worker threads that copy data into mapped GPU buffers. Workers are started on the first submit
+// and live until the program exits.
+class UploadPool {
+public:
+    /**
+     * Queues a copy of len bytes from src to dst. This never blocks, if the queue is full the copy is done on the calling thread.
+     * @param done: Set to true by the worker once the copy is finished. Must stay valid until then.
+     */
+    static void submit(void* dst, void const* src, size_t len, std::atomic<bool>* done);
+
+    // Copies using non-temporal stores. This bypasses the cache, which is what we want when writing to
+    // write-combined memory like a persistently mapped buffer
+    static void stream_copy(void* dst, void const* src, size_t len);
+
+    static size_t worker_count();
+};
+
+}
+
+#endif
\ No newline at end of file
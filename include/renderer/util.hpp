@@ -1,13 +1,37 @@
 #ifndef TITAN_RENDERER_UTIL_HPP_
 #define TITAN_RENDERER_UTIL_HPP_
 
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
 namespace titan {
 
 namespace renderer {
 
 void set_wireframe(bool wireframe);
 
+// Linked programs are cached on disk with glGetProgramBinary, keyed by a hash of the sources and the driver. A cache entry
+// that is missing or rejected by the driver is compiled from source like normal.
 unsigned int load_shader(const char* vtx_path, const char* frag_path, const char* geom_path = nullptr);
+// Directory for the program binary cache, "shader_cache" by default. An empty path disables the cache
+void set_shader_cache_directory(std::string const& path);
+
+// FNV-1a hash for cache keys. Pass the previous result as hash to combine multiple strings
+std::uint64_t hash_string(std::string const& str, std::uint64_t hash = 14695981039346656037ull);
+
+struct FileChunk {
+    void const* data;
+    size_t size;
+};
+
+// Writes the chunks one after another to a temporary file and renames it to path, so a crash halfway never leaves a
+// truncated file behind. Creates missing parent directories. Returns false if anything failed, for the disk caches that
+// is not an error, a missing entry only costs time on the next run
+bool write_file_atomic(std::filesystem::path const& path, std::initializer_list<FileChunk> chunks);
 
 unsigned int load_texture(const char* path);
 unsigned int load_cubemap(const char* descriptor_path);
@@ -15,6 +39,53 @@ unsigned int load_cubemap(const char* descriptor_path);
 unsigned int texture_from_buffer(unsigned char const* buf, size_t w, size_t h);
 unsigned int texture_from_buffer(float const* buf, size_t w, size_t h);
 
+enum class HeightmapFormat {
+    // 16 bit unsigned normalized, half the memory of R32F. Heights must be between 0 and 1
+    R16,
+    R32F
+};
+
+// Amount of mip levels down to 1x1
+size_t mip_level_count(size_t w, size_t h);
+
+/**
+ * Builds a 2x2 box filtered mip chain on the CPU, split over all cores.
+ * @param levels: Receives every level after level 0, which is buf itself. levels[0] is mip level 1
+ */
+void build_heightmap_mips(float const* buf, size_t w, size_t h, std::vector<std::vector<float>>& levels);
+
+// Uploads a heightmap with a full mip chain and trilinear filtering. Distant chunks can sample a coarser level with
+// textureLod, which keeps their texture fetches in cache
+unsigned int heightmap_texture_from_buffer(float const* buf, size_t w, size_t h, HeightmapFormat format = HeightmapFormat::R16);
+
+// Same texture as heightmap_texture_from_buffer, split up so the CPU work can run on another thread and the upload
+// can be spread over several frames
+
+// Every mip level of a heightmap, already converted to the texture format. Only the vector for format is filled
+struct HeightmapTexels {
+    HeightmapFormat format = HeightmapFormat::R16;
+    size_t width = 0;
+    size_t height = 0;
+    std::vector<std::vector<std::uint16_t>> r16;
+    std::vector<std::vector<float>> r32f;
+};
+
+// Where upload_heightmap_texels continues
+struct HeightmapUploadCursor {
+    size_t level = 0;
+    size_t row = 0;
+};
+
+// Doesn't touch GL, so this can be called from any thread
+void build_heightmap_texels(float const* buf, size_t w, size_t h, HeightmapFormat format, HeightmapTexels& texels);
+// Creates the texture with storage for every level, without uploading anything
+unsigned int create_heightmap_texture(HeightmapTexels const& texels);
+/**
+ * Uploads whole rows starting at cursor until max_bytes are uploaded, at least one row per call.
+ * @return true once every level is uploaded
+ */
+bool upload_heightmap_texels(unsigned int texture, HeightmapTexels const& texels, HeightmapUploadCursor& cursor, size_t max_bytes);
+
 }
 
 }
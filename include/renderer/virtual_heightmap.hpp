@@ -0,0 +1,95 @@
+#ifndef TITAN_RENDERER_VIRTUAL_HEIGHTMAP_HPP_
+#define TITAN_RENDERER_VIRTUAL_HEIGHTMAP_HPP_
+
+#include "generators/heightmap_terrain.hpp"
+
+#include "renderer/gl_resource.hpp"
+#include "renderer/util.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace titan::renderer {
+
+struct VirtualHeightmapInfo {
+    // Texels per page side. Pages are stored with a 1 texel border, so bilinear filtering works across page edges
+    size_t page_size = 126;
+    // The atlas holds atlas_pages * atlas_pages pages
+    size_t atlas_pages = 8;
+    // Largest side of the low resolution heightmap that is sampled where no page is resident
+    size_t fallback_size = 512;
+    // Maximum amount of pages uploaded per update
+    size_t pages_per_frame = 4;
+};
+
+// Heightmap texture for worlds that don't fit in a single texture. The heightmap is split into pages, and only the
+// pages closest to the camera are resident in a physical page atlas. A page table with one texel per page tells the
+// shaders where a page is in the atlas. Where a page isn't resident, the shaders fall back to a low resolution copy
+// of the whole heightmap. This is done in the shader instead of with sparse textures, so it works everywhere.
+struct VirtualHeightmap {
+    // R16 atlas, every slot is page_size + 2 texels wide
+    GLTexture atlas;
+    // RGBA8UI, one texel per page: atlas slot x, atlas slot y, resident
+    GLTexture page_table;
+    // Low resolution heightmap with a mip chain
+    GLTexture fallback;
+    // log2 of the heightmap size divided by the fallback size
+    float fallback_level_offset = 0;
+
+    VirtualHeightmapInfo info;
+    // Size of the full heightmap in texels
+    size_t width = 0;
+    size_t height = 0;
+    size_t pages_x = 0;
+    size_t pages_y = 0;
+
+    static constexpr std::uint32_t no_page = static_cast<std::uint32_t>(-1);
+
+    // Atlas slot of every page, or no_page
+    std::vector<std::uint32_t> page_slot;
+    // Page in every atlas slot, or no_page
+    std::vector<std::uint32_t> slot_page;
+    // CPU copy of the page table
+    std::vector<std::uint8_t> page_table_data;
+
+    // Scratch data
+    std::vector<float> page_distance;
+    std::vector<std::uint32_t> order;
+    std::vector<std::uint16_t> page_texels;
+
+    // Pages uploaded by the last update
+    size_t uploaded_pages = 0;
+};
+
+void create_virtual_heightmap(VirtualHeightmap& heightmap, HeightmapTerrain const& terrain, VirtualHeightmapInfo const& info);
+
+// CPU half of the fallback, safe to call from any thread. Fills texels with the mip chain of the fallback and returns
+// the fallback level offset
+float build_virtual_heightmap_fallback(HeightmapTerrain const& terrain, VirtualHeightmapInfo const& info,
+                                       HeightmapTexels& texels);
+// create_virtual_heightmap with a fallback from build_virtual_heightmap_fallback. Only allocates the fallback texture,
+// upload the texels to heightmap.fallback with upload_heightmap_texels before rendering
+void create_virtual_heightmap_deferred(VirtualHeightmap& heightmap, HeightmapTerrain const& terrain,
+                                       VirtualHeightmapInfo const& info, HeightmapTexels const& fallback,
+                                       float fallback_level_offset);
+void destroy_virtual_heightmap(VirtualHeightmap& heightmap);
+
+/**
+ * Streams in the pages closest to the camera, evicting the furthest resident pages once the atlas is full.
+ * Needs terrain.height_map to stay alive, pages are read from it.
+ * @param cam_pos: Pointer to a float array with 2 values with the camera position on the ground plane, in terrain space
+ */
+void update_virtual_heightmap(VirtualHeightmap& heightmap, HeightmapTerrain const& terrain, float const* cam_pos);
+
+size_t resident_page_count(VirtualHeightmap const& heightmap);
+
+/**
+ * Binds the heightmap for the grid shaders. Binds height_map to unit 0 when heightmap has no atlas, otherwise the atlas
+ * goes to unit 0 and the page table and fallback to units 6 and 7. Sets uniforms 12 to 16.
+ */
+void bind_height_map(unsigned int height_map, VirtualHeightmap const& heightmap);
+
+}
+
+#endif
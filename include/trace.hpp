@@ -0,0 +1,64 @@
+#ifndef TITAN_TRACE_HPP_
+#define TITAN_TRACE_HPP_
+
+#include <cstdint>
+#include <string>
+
+// Lightweight scoped timing zones. Every thread records into its own ring buffer, so recording a zone never takes a
+// lock. The buffers can be dumped as a Chrome trace_event JSON file, which can be opened in Perfetto or chrome://tracing.
+// Everything compiles to nothing unless TITAN_ENABLE_TRACING is defined to 1.
+
+#ifndef TITAN_ENABLE_TRACING
+    #define TITAN_ENABLE_TRACING 0
+#endif
+
+namespace titan::trace {
+
+inline constexpr bool enabled = TITAN_ENABLE_TRACING;
+
+// Nanoseconds since an arbitrary point in time
+std::uint64_t now();
+
+/**
+ * Records a finished zone for the calling thread. When the ring buffer of the thread is full, the oldest zone is overwritten.
+ * @param name: Must stay valid until the trace is written, in practice this is a string literal
+ */
+void record(char const* name, std::uint64_t start, std::uint64_t end);
+
+// Name of the calling thread in the trace. Must stay valid until the trace is written, like zone names
+void set_thread_name(char const* name);
+
+// Writes every recorded zone as Chrome trace_event JSON. Throws if tracing is disabled or the file can't be opened
+void write_chrome_trace(std::string const& path);
+
+// Removes all recorded zones
+void clear();
+
+class Zone {
+public:
+    explicit Zone(char const* name) : name(name), start(now()) {}
+    ~Zone() { record(name, start, now()); }
+
+    Zone(Zone const&) = delete;
+    Zone& operator=(Zone const&) = delete;
+
+private:
+    char const* name;
+    std::uint64_t start;
+};
+
+}
+
+#define TITAN_TRACE_CONCAT_IMPL(a, b) a##b
+#define TITAN_TRACE_CONCAT(a, b) TITAN_TRACE_CONCAT_IMPL(a, b)
+
+#if TITAN_ENABLE_TRACING
+    // Times the rest of the enclosing scope
+    #define TITAN_TRACE_ZONE(name) ::titan::trace::Zone TITAN_TRACE_CONCAT(titan_trace_zone_, __LINE__)(name)
+    #define TITAN_TRACE_THREAD_NAME(name) ::titan::trace::set_thread_name(name)
+#else
+    #define TITAN_TRACE_ZONE(name) ((void)0)
+    #define TITAN_TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+#endif
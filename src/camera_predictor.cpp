@@ -0,0 +1,47 @@
+#include "camera_predictor.hpp"
+
+#include <algorithm>
+
+namespace titan {
+
+void CameraPredictor::add_sample(glm::vec3 position, float time) {
+    samples.push_back(Sample{position, time});
+    // Drop samples that fell out of the history window, but keep at least two to get a velocity from
+    auto const first_kept = std::find_if(samples.begin(), samples.end(), [this, time](Sample const& sample) {
+        return time - sample.time <= history_seconds;
+    });
+    size_t const drop = std::min<size_t>(first_kept - samples.begin(), samples.size() - std::min<size_t>(samples.size(), 2));
+    samples.erase(samples.begin(), samples.begin() + drop);
+}
+
+glm::vec3 CameraPredictor::get_velocity() const {
+    if (samples.size() < 2) { return glm::vec3(0, 0, 0); }
+
+    // Least squares fit of position against time. This is a lot less jittery than the difference between the last two
+    // frames, since the frame time and input both vary from frame to frame
+    float mean_time = 0;
+    glm::vec3 mean_pos(0, 0, 0);
+    for (auto const& sample : samples) {
+        mean_time += sample.time;
+        mean_pos += sample.position;
+    }
+    mean_time /= samples.size();
+    mean_pos /= (float)samples.size();
+
+    float time_variance = 0;
+    glm::vec3 covariance(0, 0, 0);
+    for (auto const& sample : samples) {
+        float const dt = sample.time - mean_time;
+        time_variance += dt * dt;
+        covariance += dt * (sample.position - mean_pos);
+    }
+    if (time_variance <= 0) { return glm::vec3(0, 0, 0); }
+    return covariance / time_variance;
+}
+
+glm::vec3 CameraPredictor::predict(float seconds_ahead) const {
+    if (samples.empty()) { return glm::vec3(0, 0, 0); }
+    return samples.back().position + get_velocity() * seconds_ahead;
+}
+
+}
@@ -1,6 +1,5 @@
 #include "cinematic_camera.hpp"
 
-#include <glfw/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <cmath>
@@ -8,10 +7,9 @@
 namespace titan {
 
 void update_cinematic_camera(OrbitCamera& camera, float delta_time) {
-    // delta_time paramter is not used in this function because we already rely on the time anyway.
-    // Maybe we will remove this parameter if it turns out we don't need it for any of the cinematic cameras
-
-    float time = glfwGetTime();
+    // Accumulate our own time instead of asking glfw, so the path can be replayed with a fixed timestep
+    camera.time += delta_time;
+    float const time = camera.time;
     camera.position.x = camera.target.x + std::sin(time * camera.rotation_speed) * camera.distance_to_target.x;
     camera.position.y = camera.target.y + camera.distance_to_target.y;
     camera.position.z = camera.target.z + std::cos(time * camera.rotation_speed) * camera.distance_to_target.z;
@@ -44,6 +42,14 @@ glm::mat4 get_view_matrix(FollowCamera& camera, glm::vec3 world_up) {
     return glm::lookAt(camera.position, camera.target, cam_up);
 }
 
+glm::vec3 get_position(OrbitCamera const& camera) {
+    return camera.position;
+}
+
+glm::vec3 get_position(FollowCamera const& camera) {
+    return camera.position;
+}
+
 glm::mat4 get_view_matrix(StationaryCamera& camera, glm::vec3 world_up) {
     glm::vec3 position = camera.target + camera.distance_to_target;
     glm::vec3 cam_up = get_up_vector(position, camera.target, world_up);
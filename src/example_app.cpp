@@ -8,12 +8,23 @@
 #include <iostream>
 #include <random>
 #include <stdexcept>
+#include <vector>
 
 #include "cinematic_camera.hpp"
 #include "input.hpp"
 #include "camera.hpp"
-
+#include "camera_predictor.hpp"
+#include "frame_stats.hpp"
+#include "trace.hpp"
+
+#include "renderer/asset_loader.hpp"
+#include "renderer/frame_pipeline.hpp"
+#include "renderer/gl_resource.hpp"
+#include "renderer/gl_state.hpp"
 #include "renderer/terrain_renderer.hpp"
+#include "renderer/instanced_terrain_renderer.hpp"
+#include "renderer/render_stats.hpp"
+#include "renderer/terrain_handle.hpp"
 #include "renderer/util.hpp"
 
 #include "generators/heightmap_terrain.hpp"
@@ -52,7 +63,15 @@ static void gl_error_callback([[maybe_unused]] GLenum source,
     std::cerr << "[OpenGL] " << severity_string << ": " << message << std::endl;
 }
 
-Application::Application(size_t const width, size_t const height) {
+Application::Application(size_t const width, size_t const height, std::optional<BenchmarkOptions> benchmark) 
+    : width(width), height(height), benchmark(benchmark) {
+    if (benchmark) {
+        headless_context = titan::renderer::create_headless_context(width, height);
+        glEnable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        return;
+    }
+
     if (!glfwInit()) {
         throw std::runtime_error("Failed to initialize glfw");
     }
@@ -81,6 +100,12 @@ Application::Application(size_t const width, size_t const height) {
 }
 
 Application::~Application() {
+    // Everything run() created is queued by now, delete it while the context is still alive
+    titan::renderer::DeletionQueue::flush();
+    if (benchmark) {
+        titan::renderer::destroy_headless_context(headless_context);
+        return;
+    }
     glfwDestroyWindow(win);
     glfwTerminate();
 }
@@ -144,6 +169,7 @@ static constexpr float skybox_verts[] = {
 };
 
 void Application::run() {
+    TITAN_TRACE_THREAD_NAME("Main thread");
 
 /////////
 // https://discordapp.com/channels/318590007881236480/318783155744145411/668564420435378177
@@ -152,8 +178,11 @@ void Application::run() {
 
     titan::renderer::set_wireframe(false);
 
-    Input::initialize(win);
-    InputEventManager::init(win);
+    bool const benchmarking = benchmark.has_value();
+    if (!benchmarking) {
+        Input::initialize(win);
+        InputEventManager::init(win);
+    }
 
     AxisManager::add_axis("Horizontal");
     AxisManager::add_axis("Vertical");
@@ -181,11 +210,20 @@ void Application::run() {
     AxisManager::add_axis_mapping(pos_ver_mapping);
     AxisManager::add_axis_mapping(neg_ver_mapping);
 
-    Input::set_mouse_capture(true);
+    if (!benchmarking) {
+        Input::set_mouse_capture(true);
+    }
+
+    // Draw the terrain with one shared patch mesh per LOD instead of a mesh for every chunk
+    bool const instanced_rendering = false;
+    // When non-zero, chunk LODs are handed out from this global triangle budget instead of picked per chunk
+    size_t const triangle_budget = 0;
+    // Stream the heightmap in pages around the camera instead of keeping all of it in one texture
+    bool const virtual_heightmap = false;
 
     // Load shaders
     unsigned int shader = titan::renderer::load_shader(
-        "data/shaders/grid.vert",
+        instanced_rendering ? "data/shaders/instanced_grid.vert" : "data/shaders/grid.vert",
         "data/shaders/basic.frag");
 
     unsigned int skybox_shader = titan::renderer::load_shader(
@@ -193,26 +231,35 @@ void Application::run() {
         "data/shaders/skybox.frag"
     );
 
-    unsigned int grass = titan::renderer::load_texture("data/textures/grass.png");
-    unsigned int moss = titan::renderer::load_texture("data/textures/moss.png");
-    unsigned int stone = titan::renderer::load_texture("data/textures/stone.png");
-
-    unsigned int skybox = titan::renderer::load_cubemap("data/skybox/graycloud.txt");
+    auto const assets_start = std::chrono::steady_clock::now();
+    titan::renderer::AssetLoader asset_loader;
+    size_t const grass_index = titan::renderer::add_texture(asset_loader, "data/textures/grass.png");
+    size_t const moss_index = titan::renderer::add_texture(asset_loader, "data/textures/moss.png");
+    size_t const stone_index = titan::renderer::add_texture(asset_loader, "data/textures/stone.png");
+    size_t const skybox_index = titan::renderer::add_cubemap(asset_loader, "data/skybox/graycloud.txt");
+    // Owns the textures, they are released at the end of run()
+    std::vector<titan::renderer::GLTexture> const assets = titan::renderer::load_assets(asset_loader);
+
+    unsigned int grass = assets[grass_index].get();
+    unsigned int moss = assets[moss_index].get();
+    unsigned int stone = assets[stone_index].get();
+    unsigned int skybox = assets[skybox_index].get();
+    std::cout << "Loaded textures in " 
+              << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - assets_start).count()
+              << " ms" << std::endl;
     glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
     // Create skybox vao
-    unsigned int skybox_vao, skybox_vbo;
-    glGenVertexArrays(1, &skybox_vao);
-    glGenBuffers(1, &skybox_vbo);
+    titan::renderer::GLVertexArray const skybox_vao_object = titan::renderer::make_vertex_array();
+    titan::renderer::GLBuffer const skybox_vbo_object = titan::renderer::make_buffer();
+    unsigned int const skybox_vao = skybox_vao_object.get();
+    unsigned int const skybox_vbo = skybox_vbo_object.get();
 
-    glBindVertexArray(skybox_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, skybox_vbo);
-
-    glBufferData(GL_ARRAY_BUFFER, sizeof(skybox_verts), skybox_verts, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
-    glBindVertexBuffer(0, skybox_vbo, 0, 3 * sizeof(float));
-    glVertexAttribBinding(0, 0);
+    glNamedBufferStorage(skybox_vbo, sizeof(skybox_verts), skybox_verts, 0);
+    glEnableVertexArrayAttrib(skybox_vao, 0);
+    glVertexArrayAttribFormat(skybox_vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayVertexBuffer(skybox_vao, 0, skybox_vbo, 0, 3 * sizeof(float));
+    glVertexArrayAttribBinding(skybox_vao, 0, 0);
 
     // Create transformation matrices
 
@@ -232,7 +279,8 @@ void Application::run() {
     info.length = grid_size;
     info.height_scale = 100.0f;
     info.max_lod = 100;
-    info.noise_seed = std::random_device()();
+    // Benchmarks need the same terrain every run
+    info.noise_seed = benchmarking ? 1337 : std::random_device()();
     info.noise_size = 4096;
     info.noise_layers = 4;
     info.noise_persistence = 0.5f;
@@ -241,23 +289,55 @@ void Application::run() {
 
     milliseconds start_time = duration_cast<milliseconds>(high_resolution_clock::now().time_since_epoch());
 
-    titan::HeightmapTerrain terrain = titan::create_heightmap_terrain(info);
+    titan::renderer::VirtualHeightmapInfo const virtual_heightmap_info;
+    titan::renderer::VirtualHeightmapInfo const* virtual_heightmap_ptr = virtual_heightmap ? &virtual_heightmap_info : nullptr;
+
+    // The chunked renderer keeps its terrain in a handle, so it can be regenerated in the background while it renders
+    titan::renderer::TerrainHandle terrain_handle;
+    titan::HeightmapTerrain instanced_terrain;
+    titan::renderer::InstancedTerrainRenderInfo instanced_render_info;
+    if (instanced_rendering) {
+        instanced_terrain = titan::create_heightmap_terrain(info);
+    } else {
+        titan::renderer::TerrainHandleInfo handle_info;
+        handle_info.virtual_heightmap = virtual_heightmap_ptr;
+        titan::renderer::create_terrain_handle(terrain_handle, info, handle_info);
+    }
+    // Both point into the handle, and change when a regenerated terrain is swapped in
+    titan::HeightmapTerrain const* terrain = instanced_rendering ? &instanced_terrain : &terrain_handle.active->terrain;
+    titan::renderer::TerrainRenderInfo* render_info = instanced_rendering ? nullptr : &terrain_handle.active->render_info;
 
     std::chrono::milliseconds end_time = duration_cast<milliseconds>(high_resolution_clock::now().time_since_epoch());
     std::cout << "Generated terrain in " << (end_time - start_time).count() << " ms" << std::endl;
 
     std::cout << "Max LOD: " << info.max_lod << std::endl;
-    std::cout << "Total LOD count: " << terrain.max_lod << std::endl;
+    std::cout << "Total LOD count: " << terrain->max_lod << std::endl;
 
     size_t const lod = 0;
-    size_t cur_lod = terrain.max_lod / 2;
-
-    start_time = duration_cast<milliseconds>(high_resolution_clock::now().time_since_epoch());
-
-    titan::renderer::TerrainRenderInfo render_info = titan::renderer::make_terrain_render_info(terrain, terrain.max_lod / 2);
+    size_t cur_lod = terrain->max_lod / 2;
+
+    if (instanced_rendering) {
+        start_time = duration_cast<milliseconds>(high_resolution_clock::now().time_since_epoch());
+        instanced_render_info = titan::renderer::make_instanced_terrain_render_info(*terrain, terrain->max_lod / 2, 
+            titan::renderer::HeightmapFormat::R16, virtual_heightmap_ptr);
+        end_time = duration_cast<milliseconds>(high_resolution_clock::now().time_since_epoch());
+        std::cout << "Data upload finished  in " << (end_time - start_time).count() << " ms" << std::endl;
+    }
 
-    end_time = duration_cast<milliseconds>(high_resolution_clock::now().time_since_epoch());
-    std::cout << "Data upload finished  in " << (end_time - start_time).count() << " ms" << std::endl;
+    auto print_buffer_pool_usage = [&render_info] () {
+        auto const usage = render_info->buffer_pool.usage();
+        for (size_t lod = 0; lod < usage.size(); ++lod) {
+            std::cout << "LOD " << lod << " blocks: " << usage[lod].blocks_used << "/" << usage[lod].blocks_reserved
+                      << " (" << usage[lod].bytes_used / 1024 << " KiB used, " << usage[lod].bytes_reserved / 1024 << " KiB reserved)\n";
+        }
+        std::cout << "Total: " << render_info->buffer_pool.bytes_used() / 1024 << "/" << render_info->buffer_pool.budget() / 1024 << " KiB" << std::endl;
+        auto const& prefetch = render_info->prefetch_stats;
+        std::cout << "Prefetch: " << prefetch.issued << " issued, " << prefetch.hits << " hits, " << prefetch.misses << " misses ("
+                  << titan::renderer::prefetch_hit_rate(prefetch) * 100.0f << "% hit rate)" << std::endl;
+    };
+    if (!instanced_rendering) {
+        print_buffer_pool_usage();
+    }
 
     // Create camera
 
@@ -265,18 +345,41 @@ void Application::run() {
     camera.mouse_sensitivity = 5.0f;
     camera.move_speed = 5.0f;
 
+    // Load LODs for where the camera will be this far ahead
+    float const prefetch_seconds = 1.0f;
+    titan::CameraPredictor camera_predictor;
+
+    // Benchmarks circle the terrain instead of following input
+    titan::OrbitCamera benchmark_camera = titan::create_cinematic_camera<titan::OrbitCamera>(
+        glm::vec3(grid_size / 2.0f, -info.height_scale / 2.0f, grid_size / 2.0f));
+    benchmark_camera.distance_to_target = glm::vec3(grid_size / 2.0f, info.height_scale * 0.6f, grid_size / 2.0f);
+    benchmark_camera.rotation_speed = 0.2f;
+    std::vector<titan::FrameStats> frame_stats;
+    size_t frame = 0;
+
+    titan::renderer::RenderStats render_stats;
+    titan::renderer::create_render_stats(render_stats);
+
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
 
+    int window_width = width, window_height = height;
+    if (!benchmarking) {
+        glfwGetWindowSize(win, &window_width, &window_height);
+    }
+    titan::renderer::LODSelectionParams const lod_selection = titan::renderer::make_lod_selection_params(projection, window_height);
+
     // Increasing LOD means going to a lower index
 
     ActionBinding increase_lod;
     increase_lod.key = Key::Up;
     increase_lod.when = KeyAction::Press;
     increase_lod.callback = [&terrain, &cur_lod, &render_info] () {
-        if (cur_lod == 0) { return; }
-        titan::renderer::higher_lod(render_info, terrain, 0);
-        --cur_lod;
+        if (cur_lod == 0 || !render_info) { return; }
+        // Doesn't switch while the next LOD is still being uploaded
+        if (titan::renderer::higher_lod(*render_info, *terrain, 0)) {
+            --cur_lod;
+        }
     };
 
     // Decreasing LOD means going to a higher index
@@ -285,13 +388,55 @@ void Application::run() {
     decrease_lod.key = Key::Down;
     decrease_lod.when = KeyAction::Press;
     decrease_lod.callback = [&terrain, &cur_lod, &render_info] () {
-        if (cur_lod == terrain.max_lod - 1) { return; }
-        titan::renderer::lower_lod(render_info, terrain, 0);
-        ++cur_lod;
+        if (cur_lod == terrain->max_lod - 1 || !render_info) { return; }
+        if (titan::renderer::lower_lod(*render_info, *terrain, 0)) {
+            ++cur_lod;
+        }
+    };
+
+    ActionBinding print_pool_usage;
+    print_pool_usage.key = Key::P;
+    print_pool_usage.when = KeyAction::Press;
+    print_pool_usage.callback = [&print_buffer_pool_usage, instanced_rendering] () {
+        if (!instanced_rendering) { print_buffer_pool_usage(); }
     };
 
     ActionBindingManager::add_action(increase_lod);
     ActionBindingManager::add_action(decrease_lod);
+    ActionBindingManager::add_action(print_pool_usage);
+
+    ActionBinding write_trace;
+    write_trace.key = Key::T;
+    write_trace.when = KeyAction::Press;
+    write_trace.callback = [] () {
+        if (!titan::trace::enabled) { return; }
+        titan::trace::write_chrome_trace("titan_trace.json");
+        std::cout << "Wrote trace to titan_trace.json" << std::endl;
+    };
+
+    ActionBindingManager::add_action(write_trace);
+
+    ActionBinding print_stats;
+    print_stats.key = Key::R;
+    print_stats.when = KeyAction::Press;
+    print_stats.callback = [&render_stats] () {
+        titan::renderer::print_render_stats(std::cout, render_stats);
+        std::cout << std::flush;
+    };
+
+    ActionBindingManager::add_action(print_stats);
+
+    // New seed, the current terrain keeps rendering until the new one is ready
+    ActionBinding regenerate;
+    regenerate.key = Key::G;
+    regenerate.when = KeyAction::Press;
+    regenerate.callback = [&terrain_handle, &info, instanced_rendering] () {
+        if (instanced_rendering) { return; }
+        info.noise_seed = std::random_device()();
+        titan::renderer::request_terrain_rebuild(terrain_handle, info);
+    };
+
+    ActionBindingManager::add_action(regenerate);
 
     ActionBinding quit;
     quit.key = Key::Escape;
@@ -302,47 +447,107 @@ void Application::run() {
 
     ActionBindingManager::add_action(quit);
 
-    for (auto& chunk : render_info.chunks) {
-        titan::renderer::await_all_data_upload(chunk);
+    if (render_info) {
+        for (auto& chunk : render_info->chunks) {
+            titan::renderer::await_all_data_upload(chunk);
+        }
+    }
+
+    // Culling, LOD selection and building the draw list run on a worker thread one frame ahead
+    titan::renderer::FramePipeline frame_pipeline;
+    if (!instanced_rendering) {
+        titan::renderer::create_frame_pipeline(frame_pipeline, *render_info, *terrain, lod_selection, triangle_budget);
     }
 
-    while (!glfwWindowShouldClose(win)) {
-        float frame_time = glfwGetTime();
+    while (benchmarking ? frame < benchmark->frames : !glfwWindowShouldClose(win)) {
+        auto const cpu_start = std::chrono::steady_clock::now();
+        titan::FrameStats stats;
+        titan::renderer::begin_render_stats(render_stats);
+
+        float frame_time = benchmarking ? frame * benchmark->time_step : glfwGetTime();
         d_time = frame_time - last_frame_time;
         last_frame_time = frame_time;
 
-        InputEventManager::process_events(frame_time);
+        if (!benchmarking) {
+            InputEventManager::process_events(frame_time);
+
+            if (RawInput::get_key(Key::Escape).down) {
+                glfwSetWindowShouldClose(win, true);
+            }
+        }
 
-        if (RawInput::get_key(Key::Escape).down) {
-            glfwSetWindowShouldClose(win, true);
+        // Swap in a regenerated terrain at the frame boundary, before anything looks at the terrain for this frame
+        bool swapped_terrain = false;
+        try {
+            swapped_terrain = !instanced_rendering && titan::renderer::update_terrain_handle(terrain_handle);
+        } catch (std::exception const& e) {
+            std::cout << "Terrain rebuild failed: " << e.what() << std::endl;
+        }
+        if (swapped_terrain) {
+            // The prepare worker may still be reading the old terrain, only free it once the worker stopped
+            titan::renderer::destroy_frame_pipeline(frame_pipeline);
+            titan::renderer::release_retired_terrain(terrain_handle);
+            terrain = &terrain_handle.active->terrain;
+            render_info = &terrain_handle.active->render_info;
+            cur_lod = terrain->max_lod / 2;
+            titan::renderer::create_frame_pipeline(frame_pipeline, *render_info, *terrain, lod_selection, triangle_budget);
+            std::cout << "Swapped in terrain with seed " << terrain_handle.active->info.noise_seed << std::endl;
         }
 
         glClearColor(0, 0, 0, 1);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        camera.update(d_time);
-        glm::vec3 pos = camera.get_position();
+        glm::vec3 pos;
+        glm::mat4 view;
+        if (benchmarking) {
+            titan::update_cinematic_camera(benchmark_camera, d_time);
+            pos = titan::get_position(benchmark_camera);
+            view = titan::get_view_matrix(benchmark_camera, glm::vec3(0, 1, 0));
+        } else {
+            camera.update(d_time);
+            pos = camera.get_position();
+            view = camera.get_view_matrix();
+        }
+        camera_predictor.add_sample(pos, frame_time);
+        titan::renderer::PreparedFrame const* prepared_frame = nullptr;
         
-        titan::renderer::update_lod_distance(render_info, terrain, model, glm::value_ptr(pos));
-
-        glm::mat4 view = camera.get_view_matrix();
+        // Cull before updating LODs, so we don't upload LODs for chunks we can't see
+        if (instanced_rendering) {
+            titan::renderer::cull_terrain(instanced_render_info, projection * view * model);
+            titan::renderer::occlusion_cull_terrain(instanced_render_info, model, glm::value_ptr(pos));
+            titan::renderer::update_lod_distance(instanced_render_info, *terrain, model, glm::value_ptr(pos));
+            titan::renderer::update_height_map_pages(instanced_render_info, *terrain, model, glm::value_ptr(pos));
+        } else {
+            titan::renderer::FrameInput input;
+            input.view = view;
+            input.projection = projection;
+            input.terrain_transform = model;
+            input.cam_pos = pos;
+            input.predicted_pos = camera_predictor.predict(prefetch_seconds);
+            prepared_frame = &titan::renderer::advance_frame_pipeline(frame_pipeline, *render_info, input);
+            // Draw the frame that was prepared, which is one frame behind the input
+            view = prepared_frame->input.view;
+            pos = prepared_frame->input.cam_pos;
+            titan::renderer::update_height_map_pages(*render_info, *terrain, model, glm::value_ptr(pos));
+        }
 
         // Render skybox
         glDepthMask(0x00);
         glDepthFunc(GL_LEQUAL);
         glm::mat4 skybox_view = glm::mat4(glm::mat3(view));
-        glBindVertexArray(skybox_vao);
-        glUseProgram(skybox_shader);
+        titan::renderer::GLStateCache::bind_vertex_array(skybox_vao);
+        titan::renderer::GLStateCache::use_program(skybox_shader);
         glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(projection));
         glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(skybox_view));
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, skybox);
+        titan::renderer::GLStateCache::bind_texture_unit(0, skybox);
         glUniform1i(2, 0);
         glDrawArrays(GL_TRIANGLES, 0, 36);
+        stats.draw_calls += 1;
+        stats.triangles += 12;
         glDepthFunc(GL_LESS);
         glDepthMask(0xFF);
 
-        glUseProgram(shader);
+        titan::renderer::GLStateCache::use_program(shader);
 
         glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(model));
         glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(view));
@@ -352,25 +557,61 @@ void Application::run() {
 //        glUniform3fv(6, 1, glm::value_ptr(camera.get_position()));
 //        glUniform3fv(7, 1, glm::value_ptr(camera.get_forward()));
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, grass);
-
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, moss);
-
-        glActiveTexture(GL_TEXTURE3);
-
-        glBindTexture(GL_TEXTURE_2D, stone);
-
-        glUniform1f(4, terrain.height_scale);
-
-        titan::renderer::render_terrain(render_info);
-
-
+        titan::renderer::GLStateCache::bind_texture_unit(1, grass);
+        titan::renderer::GLStateCache::bind_texture_unit(2, moss);
+        titan::renderer::GLStateCache::bind_texture_unit(3, stone);
+
+        glUniform1f(4, terrain->height_scale);
+
+        titan::renderer::DrawStats terrain_stats;
+        if (instanced_rendering) {
+            glUniform2f(8, terrain->width, terrain->length);
+            terrain_stats = titan::renderer::render_terrain(instanced_render_info);
+            stats.upload_bytes = instanced_render_info.uploaded_bytes;
+            titan::renderer::end_render_stats(render_stats, instanced_render_info, terrain_stats);
+        } else {
+            terrain_stats = titan::renderer::submit_prepared_frame(*render_info, *terrain, *prepared_frame);
+            stats.upload_bytes = render_info->uploaded_bytes;
+            titan::renderer::end_render_stats(render_stats, *render_info, terrain_stats);
+        }
+        stats.draw_calls += terrain_stats.draw_calls;
+        stats.triangles += terrain_stats.triangles;
+
+        // Free resources the GPU is done with, and fence the ones released this frame
+        titan::renderer::DeletionQueue::end_frame();
+
+        if (benchmarking) {
+            using ms = std::chrono::duration<float, std::milli>;
+            auto const submitted = std::chrono::steady_clock::now();
+            // Wait for the GPU, so frame_ms includes the actual rendering
+            glFinish();
+            auto const finished = std::chrono::steady_clock::now();
+            stats.cpu_ms = ms(submitted - cpu_start).count();
+            stats.frame_ms = ms(finished - cpu_start).count();
+            frame_stats.push_back(stats);
+            ++frame;
+            continue;
+        }
 
         glfwPollEvents();
         glfwSwapBuffers(win);
     }
+
+    if (!instanced_rendering) {
+        titan::renderer::destroy_frame_pipeline(frame_pipeline);
+        titan::renderer::destroy_terrain_handle(terrain_handle);
+    }
+
+    if (benchmarking) {
+        char const* renderer = reinterpret_cast<char const*>(glGetString(GL_RENDERER));
+        titan::write_frame_stats_json(benchmark->output_path, frame_stats, renderer ? renderer : "unknown", benchmark->time_step);
+        std::cout << "Wrote " << frame_stats.size() << " frames to " << benchmark->output_path << std::endl;
+        titan::renderer::print_render_stats(std::cout, render_stats);
+        if (titan::trace::enabled) {
+            titan::trace::write_chrome_trace(benchmark->output_path + ".trace.json");
+        }
+    }
+    titan::renderer::destroy_render_stats(render_stats);
 }
 
 float Application::delta_time() const {
@@ -0,0 +1,50 @@
+#include "frame_stats.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+namespace titan {
+
+static std::string escape_json(std::string const& str) {
+    std::string result;
+    for (char c : str) {
+        if (c == '"' || c == '\\') { result += '\\'; }
+        result += c;
+    }
+    return result;
+}
+
+void write_frame_stats_json(std::string const& path, std::vector<FrameStats> const& frames, 
+                            std::string const& renderer, float time_step) {
+    std::ofstream out(path);
+    if (!out.good()) {
+        throw std::runtime_error("Failed to open " + path + " for writing");
+    }
+
+    float total_cpu_ms = 0;
+    float total_frame_ms = 0;
+    for (auto const& frame : frames) {
+        total_cpu_ms += frame.cpu_ms;
+        total_frame_ms += frame.frame_ms;
+    }
+    float const count = frames.empty() ? 1.0f : (float)frames.size();
+
+    out << "{\n";
+    out << "  \"renderer\": \"" << escape_json(renderer) << "\",\n";
+    out << "  \"time_step\": " << time_step << ",\n";
+    out << "  \"frame_count\": " << frames.size() << ",\n";
+    out << "  \"average_cpu_ms\": " << total_cpu_ms / count << ",\n";
+    out << "  \"average_frame_ms\": " << total_frame_ms / count << ",\n";
+    out << "  \"frames\": [\n";
+    for (size_t i = 0; i < frames.size(); ++i) {
+        auto const& frame = frames[i];
+        out << "    {\"cpu_ms\": " << frame.cpu_ms << ", \"frame_ms\": " << frame.frame_ms 
+            << ", \"draw_calls\": " << frame.draw_calls << ", \"triangles\": " << frame.triangles 
+            << ", \"upload_bytes\": " << frame.upload_bytes << "}";
+        out << (i + 1 < frames.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+}
@@ -1,12 +1,14 @@
 #include "generators/grid_mesh.hpp"
 
 #include "math.hpp"
+#include "trace.hpp"
 
 namespace titan {
 
 using namespace math;
 
 GridMesh create_grid_mesh(float const width, float const height, size_t const resolution, GridMeshOptions options) {
+    TITAN_TRACE_ZONE("create_grid_mesh");
     GridMesh mesh;
 
     mesh.resolution = resolution;
@@ -2,7 +2,9 @@
 #include "generators/noise.hpp"
 
 #include "math.hpp"
+#include "trace.hpp"
 
+#include <algorithm>
 #include <thread>
 #include <iostream>
 
@@ -29,7 +31,7 @@ static float sample_height_texel(HeightmapTerrain const& terrain, size_t x, size
     return terrain.height_map[index_2d(x, y, terrain.heightmap_width)];
 }
 
-static float sample_height_linear(HeightmapTerrain const& terrain, float x, float y) {
+float sample_height_linear(HeightmapTerrain const& terrain, float x, float y) {
     float const sample_interval_x = 1.0f / terrain.heightmap_width;
     float const sample_interval_y = 1.0f / terrain.heightmap_height;
 
@@ -61,7 +63,8 @@ static float sample_height_linear(HeightmapTerrain const& terrain, float x, floa
     return lerp(height_a, height_b, dy);
 }
 
-static void calculate_normals(HeightmapTerrain& terrain, GridMesh& mesh) {
+void calculate_normals(HeightmapTerrain const& terrain, GridMesh& mesh) {
+    TITAN_TRACE_ZONE("calculate_normals");
     // Loop over each face
     auto const& indices = mesh.indices;
     auto& vertices = mesh.vertices;
@@ -110,6 +113,57 @@ static void calculate_normals(HeightmapTerrain& terrain, GridMesh& mesh) {
     }
 }
 
+static void calculate_height_bounds(HeightmapTerrain const& terrain, HeightmapTerrain::Chunk& chunk) {
+    // Texels covered by this chunk, rounded outwards so the linear filtering of the border texels is included
+    size_t const first_x = std::floor(chunk.xoffset / terrain.width * (terrain.heightmap_width - 1.0f));
+    size_t const last_x = std::ceil((chunk.xoffset + chunk.width) / terrain.width * (terrain.heightmap_width - 1.0f));
+    size_t const first_y = std::floor(chunk.yoffset / terrain.length * (terrain.heightmap_height - 1.0f));
+    size_t const last_y = std::ceil((chunk.yoffset + chunk.length) / terrain.length * (terrain.heightmap_height - 1.0f));
+
+    chunk.min_height = sample_height_texel(terrain, first_x, first_y);
+    chunk.max_height = chunk.min_height;
+    for (size_t y = first_y; y <= std::min(last_y, terrain.heightmap_height - 1); ++y) {
+        for (size_t x = first_x; x <= std::min(last_x, terrain.heightmap_width - 1); ++x) {
+            float const height = sample_height_texel(terrain, x, y);
+            chunk.min_height = std::min(chunk.min_height, height);
+            chunk.max_height = std::max(chunk.max_height, height);
+        }
+    }
+}
+
+// Geometric error of a LOD: how far the surface of the LOD mesh is off from the surface of the highest detail mesh.
+// Measured at the vertices of the highest detail mesh, the LOD surface is interpolated between its own vertices.
+static float calculate_lod_error(HeightmapTerrain const& terrain, HeightmapTerrain::Chunk const& chunk,
+                                 size_t const lod_resolution, size_t const max_resolution) {
+    float const lod_cells = lod_resolution - 1;
+    float const max_cells = max_resolution - 1;
+
+    auto sample_chunk = [&terrain, &chunk](float const fx, float const fy) {
+        return sample_height_linear(terrain, (chunk.xoffset + fx * chunk.width) / terrain.width,
+                                             (chunk.yoffset + fy * chunk.length) / terrain.length);
+    };
+
+    float error = 0;
+    for (size_t y = 0; y < max_resolution; ++y) {
+        for (size_t x = 0; x < max_resolution; ++x) {
+            float const fx = x / max_cells;
+            float const fy = y / max_cells;
+            // Cell of the LOD mesh this vertex is in
+            float const cell_x = std::min(std::floor(fx * lod_cells), lod_cells - 1);
+            float const cell_y = std::min(std::floor(fy * lod_cells), lod_cells - 1);
+            float const dx = fx * lod_cells - cell_x;
+            float const dy = fy * lod_cells - cell_y;
+
+            float const lod_height = lerp(
+                lerp(sample_chunk(cell_x / lod_cells, cell_y / lod_cells), sample_chunk((cell_x + 1) / lod_cells, cell_y / lod_cells), dx),
+                lerp(sample_chunk(cell_x / lod_cells, (cell_y + 1) / lod_cells), sample_chunk((cell_x + 1) / lod_cells, (cell_y + 1) / lod_cells), dx),
+                dy);
+            error = std::max(error, std::abs(sample_chunk(fx, fy) - lod_height));
+        }
+    }
+    return error * terrain.height_scale;
+}
+
 static void generate_chunk_lod(HeightmapTerrain& terrain, HeightmapTerrain::Chunk& chunk, HeightmapTerrainInfo const& info, 
                                size_t const lod_index, size_t const lod) {
     
@@ -120,9 +174,12 @@ static void generate_chunk_lod(HeightmapTerrain& terrain, HeightmapTerrain::Chun
     options.yoffset = chunk.yoffset;
     chunk.meshes[lod_index] = create_grid_mesh(chunk.width, chunk.length, lod, options);
     calculate_normals(terrain, chunk.meshes[lod_index]);
+    chunk.lod_error[lod_index] = calculate_lod_error(terrain, chunk, lod, info.max_lod);
 }
 
 static void generate_lod(HeightmapTerrain& terrain, HeightmapTerrainInfo const& info, size_t const lod_index, size_t const lod) {
+    TITAN_TRACE_THREAD_NAME("LOD thread");
+    TITAN_TRACE_ZONE("generate_lod");
     for (size_t x = 0; x < terrain.chunks_x; ++x) {
         for (size_t y = 0; y < terrain.chunks_y; ++y) {
             size_t const chunk_id = index_2d(x, y, terrain.chunks_x);
@@ -132,7 +189,24 @@ static void generate_lod(HeightmapTerrain& terrain, HeightmapTerrainInfo const&
 }
 
 
+float max_noise_height(HeightmapTerrainInfo const& info) {
+    // Every octave adds at most its amplitude
+    float max_height = 0.0f;
+    float amplitude = 1.0f;
+    for (size_t octave = 0; octave < info.noise_layers; ++octave) {
+        amplitude *= info.noise_persistence;
+        max_height += amplitude;
+    }
+    return max_height;
+}
+
+float heightmap_noise_scale(HeightmapTerrainInfo const& info) {
+    float const max_height = max_noise_height(info);
+    return max_height > 1.0f ? 1.0f / max_height : 1.0f;
+}
+
 HeightmapTerrain create_heightmap_terrain(HeightmapTerrainInfo const& info) {
+    TITAN_TRACE_ZONE("create_heightmap_terrain");
     HeightmapTerrain terrain;
 
     terrain.width = info.width;
@@ -142,8 +216,19 @@ HeightmapTerrain create_heightmap_terrain(HeightmapTerrainInfo const& info) {
     terrain.heightmap_height = info.noise_size;
 
     // Create noise buffer
-    PerlinNoise noise(info.noise_seed);
-    terrain.height_map = noise.get_buffer_float(info.noise_size, info.noise_layers);
+    if (info.noise_cache) {
+        terrain.height_map = info.noise_cache->get_buffer_float(info.noise_seed, info.noise_size, info.noise_layers,
+                                                                info.noise_persistence);
+    } else {
+        PerlinNoise noise(info.noise_seed);
+        terrain.height_map = noise.get_buffer_float(info.noise_size, info.noise_layers, info.noise_persistence);
+    }
+    float const noise_scale = heightmap_noise_scale(info);
+    if (noise_scale != 1.0f) {
+        for (float& height : terrain.height_map) {
+            height *= noise_scale;
+        }
+    }
 
     size_t resolution = info.max_lod;
 
@@ -177,11 +262,14 @@ HeightmapTerrain create_heightmap_terrain(HeightmapTerrainInfo const& info) {
             chunk.length = terrain.chunk_size;
 
             chunk.meshes.resize(terrain.max_lod);
+            chunk.lod_error.resize(terrain.max_lod);
 
             chunk.height_at_center = terrain.height_scale * 1;
                                      sample_height(terrain, 
                                                   (chunk.xoffset + chunk.width / 2.0f) / terrain.width, 
                                                   (chunk.yoffset + chunk.length / 2.0f) / terrain.length);
+
+            calculate_height_bounds(terrain, chunk);
         }
     }
 
@@ -199,6 +287,13 @@ HeightmapTerrain create_heightmap_terrain(HeightmapTerrainInfo const& info) {
         thread.join();
     }
 
+    // A lower detail LOD is never more accurate than a higher detail one, even if the samples happen to line up
+    for (auto& chunk : terrain.mesh.chunks) {
+        for (size_t lod = 1; lod < lod_count; ++lod) {
+            chunk.lod_error[lod] = std::max(chunk.lod_error[lod], chunk.lod_error[lod - 1]);
+        }
+    }
+
     return terrain;
 }
 
@@ -1,5 +1,7 @@
 #include "generators/noise.hpp"
+#include "trace.hpp"
 
+#include <algorithm>
 #include <cmath>
 
 #include <stdexcept>
@@ -80,58 +82,61 @@ static float perlin_noise(float const x, float const y, vec2 const g00, vec2 con
     return 1.4142135f * lerp(lerped_x0, lerped_x1, y_lerp_factor);
 }
 
-// size is a power of 2.
+// Calls write(index, value) for every texel of an octave, with value the raw noise between -1 and 1. size is a power of 2.
+template<typename Write>
+static void generate_octave(u32 const size, u32 const octave, GradientGrid const& grid, Write&& write) {
+    TITAN_TRACE_ZONE("noise octave");
+    f32 const size_f32 = size;
+    u64 const noise_scale = 1 << octave;
+    f32 const noise_scale_f32 = noise_scale;
+    f32 const increment = 1.0f / size_f32 * noise_scale_f32;
+    u64 const resample_period = size / noise_scale;
+    if (resample_period >= 4) {
+        for (u64 y = 0; y < size; ++y) {
+            f32 const y_coord = (f32)y / size_f32 * noise_scale_f32;
+            u64 const sample_offset_y = y_coord;
+            for (u64 x = 0, sample_offset_x = 0; sample_offset_x < noise_scale; ++sample_offset_x) {
+                vec2 const g00 = grid.at(sample_offset_x, sample_offset_y);
+                vec2 const g10 = grid.at(sample_offset_x + 1, sample_offset_y);
+                vec2 const g01 = grid.at(sample_offset_x, sample_offset_y + 1);
+                vec2 const g11 = grid.at(sample_offset_x + 1, sample_offset_y + 1);
+                for (u64 i = 0; i < resample_period; i += 4, x += 4) {
+                    f32 const x_coord = (f32)x / size_f32 * noise_scale_f32;
+                    write(y * size + x, perlin_noise(x_coord, y_coord, g00, g10, g01, g11));
+                    write(y * size + x + 1, perlin_noise(x_coord + 1 * increment, y_coord, g00, g10, g01, g11));
+                    write(y * size + x + 2, perlin_noise(x_coord + 2 * increment, y_coord, g00, g10, g01, g11));
+                    write(y * size + x + 3, perlin_noise(x_coord + 3 * increment, y_coord, g00, g10, g01, g11));
+                }
+            }
+        }
+    } else {
+        for (u64 y = 0; y < size; ++y) {
+            f32 const y_coord = (f32)y / size_f32 * noise_scale_f32;
+            u64 const sample_offset_y = y_coord;
+            for (u64 x = 0; x < size; ++x) {
+                f32 const x_coord = (f32)x / size_f32 * noise_scale_f32;
+                u64 const sample_offset_x = x_coord;
+                vec2 const g00 = grid.at(sample_offset_x, sample_offset_y);
+                vec2 const g10 = grid.at(sample_offset_x + 1, sample_offset_y);
+                vec2 const g01 = grid.at(sample_offset_x, sample_offset_y + 1);
+                vec2 const g11 = grid.at(sample_offset_x + 1, sample_offset_y + 1);
+                write(y * size + x, perlin_noise(x_coord, y_coord, g00, g10, g01, g11));
+            }
+        }
+    }
+}
+
 static void generate_noise(unsigned char* const buffer, u32 const size, u32 const octaves, f32 const persistence,
                            std::mt19937& random_engine) {
+    TITAN_TRACE_ZONE("generate_noise");
     f32 amplitude = 1.0f;
-    f32 const size_f32 = size;
-    u64 const size_4aligned = size & (~0x3);
     GradientGrid const grid = create_gradient_grid(1 << (octaves - 1), random_engine);
 
     for (u32 octave = 0; octave < octaves; ++octave) {
         amplitude *= persistence;
-        u64 const noise_scale = 1 << octave;
-        f32 const noise_scale_f32 = noise_scale;
-        f32 const increment = 1.0f / size_f32 * noise_scale_f32;
-        u64 const resample_period = size / noise_scale;
-        if (resample_period >= 4) {
-            for (u64 y = 0; y < size; ++y) {
-                f32 const y_coord = (f32)y / size_f32 * noise_scale_f32;
-                u64 const sample_offset_y = y_coord;
-                for (u64 x = 0, sample_offset_x = 0; sample_offset_x < noise_scale; ++sample_offset_x) {
-                    vec2 const g00 = grid.at(sample_offset_x, sample_offset_y);
-                    vec2 const g10 = grid.at(sample_offset_x + 1, sample_offset_y);
-                    vec2 const g01 = grid.at(sample_offset_x, sample_offset_y + 1);
-                    vec2 const g11 = grid.at(sample_offset_x + 1, sample_offset_y + 1);
-                    for (u64 i = 0; i < resample_period; i += 4, x += 4) {
-                        f32 const x_coord = (f32)x / size_f32 * noise_scale_f32;
-                        f32 const val0 = perlin_noise(x_coord, y_coord, g00, g10, g01, g11);
-                        f32 const val1 = perlin_noise(x_coord + 1 * increment, y_coord, g00, g10, g01, g11);
-                        f32 const val2 = perlin_noise(x_coord + 2 * increment, y_coord, g00, g10, g01, g11);
-                        f32 const val3 = perlin_noise(x_coord + 3 * increment, y_coord, g00, g10, g01, g11);
-                        buffer[y * size + x] += 255.0f * amplitude * (0.5f + 0.5f * val0);
-                        buffer[y * size + x + 1] += 255.0f * amplitude * (0.5f + 0.5f * val1);
-                        buffer[y * size + x + 2] += 255.0f * amplitude * (0.5f + 0.5f * val2);
-                        buffer[y * size + x + 3] += 255.0f * amplitude * (0.5f + 0.5f * val3);
-                    }
-                }
-            }
-        } else {
-            for (u64 y = 0; y < size; ++y) {
-                f32 const y_coord = (f32)y / size_f32 * noise_scale_f32;
-                u64 const sample_offset_y = y_coord;
-                for (u64 x = 0; x < size; ++x) {
-                    f32 const x_coord = (f32)x / size_f32 * noise_scale_f32;
-                    u64 const sample_offset_x = x_coord;
-                    vec2 const g00 = grid.at(sample_offset_x, sample_offset_y);
-                    vec2 const g10 = grid.at(sample_offset_x + 1, sample_offset_y);
-                    vec2 const g01 = grid.at(sample_offset_x, sample_offset_y + 1);
-                    vec2 const g11 = grid.at(sample_offset_x + 1, sample_offset_y + 1);
-                    f32 const val = perlin_noise(x_coord, y_coord, g00, g10, g01, g11);
-                    buffer[y * size + x] += 255.0f * amplitude * (0.5f + 0.5f * val);
-                }
-            }
-        }
+        generate_octave(size, octave, grid, [buffer, amplitude] (u64 const i, f32 const val) {
+            buffer[i] += 255.0f * amplitude * (0.5f + 0.5f * val);
+        });
     }
     destroy_gradient_grid(grid);
 }
@@ -139,55 +144,15 @@ static void generate_noise(unsigned char* const buffer, u32 const size, u32 cons
 // Same function but for float buffer
 static void generate_noise(float* buffer, u32 const size, u32 const octaves, f32 const persistence,
                            std::mt19937& random_engine) {
+    TITAN_TRACE_ZONE("generate_noise");
     f32 amplitude = 1.0f;
-    f32 const size_f32 = size;
-    u64 const size_4aligned = size & (~0x3);
     GradientGrid const grid = create_gradient_grid(1 << (octaves - 1), random_engine);
 
     for (u32 octave = 0; octave < octaves; ++octave) {
         amplitude *= persistence;
-        u64 const noise_scale = 1 << octave;
-        f32 const noise_scale_f32 = noise_scale;
-        f32 const increment = 1.0f / size_f32 * noise_scale_f32;
-        u64 const resample_period = size / noise_scale;
-        if (resample_period >= 4) {
-            for (u64 y = 0; y < size; ++y) {
-                f32 const y_coord = (f32)y / size_f32 * noise_scale_f32;
-                u64 const sample_offset_y = y_coord;
-                for (u64 x = 0, sample_offset_x = 0; sample_offset_x < noise_scale; ++sample_offset_x) {
-                    vec2 const g00 = grid.at(sample_offset_x, sample_offset_y);
-                    vec2 const g10 = grid.at(sample_offset_x + 1, sample_offset_y);
-                    vec2 const g01 = grid.at(sample_offset_x, sample_offset_y + 1);
-                    vec2 const g11 = grid.at(sample_offset_x + 1, sample_offset_y + 1);
-                    for (u64 i = 0; i < resample_period; i += 4, x += 4) {
-                        f32 const x_coord = (f32)x / size_f32 * noise_scale_f32;
-                        f32 const val0 = perlin_noise(x_coord, y_coord, g00, g10, g01, g11);
-                        f32 const val1 = perlin_noise(x_coord + 1 * increment, y_coord, g00, g10, g01, g11);
-                        f32 const val2 = perlin_noise(x_coord + 2 * increment, y_coord, g00, g10, g01, g11);
-                        f32 const val3 = perlin_noise(x_coord + 3 * increment, y_coord, g00, g10, g01, g11);
-                        buffer[y * size + x] += amplitude * (0.5f + 0.5f * val0);
-                        buffer[y * size + x + 1] += amplitude * (0.5f + 0.5f * val1);
-                        buffer[y * size + x + 2] += amplitude * (0.5f + 0.5f * val2);
-                        buffer[y * size + x + 3] += amplitude * (0.5f + 0.5f * val3);
-                    }
-                }
-            }
-        } else {
-            for (u64 y = 0; y < size; ++y) {
-                f32 const y_coord = (f32)y / size_f32 * noise_scale_f32;
-                u64 const sample_offset_y = y_coord;
-                for (u64 x = 0; x < size; ++x) {
-                    f32 const x_coord = (f32)x / size_f32 * noise_scale_f32;
-                    u64 const sample_offset_x = x_coord;
-                    vec2 const g00 = grid.at(sample_offset_x, sample_offset_y);
-                    vec2 const g10 = grid.at(sample_offset_x + 1, sample_offset_y);
-                    vec2 const g01 = grid.at(sample_offset_x, sample_offset_y + 1);
-                    vec2 const g11 = grid.at(sample_offset_x + 1, sample_offset_y + 1);
-                    f32 const val = perlin_noise(x_coord, y_coord, g00, g10, g01, g11);
-                    buffer[y * size + x] += amplitude * (0.5f + 0.5f * val);
-                }
-            }
-        }
+        generate_octave(size, octave, grid, [buffer, amplitude] (u64 const i, f32 const val) {
+            buffer[i] += amplitude * (0.5f + 0.5f * val);
+        });
     }
     destroy_gradient_grid(grid);
 }
@@ -201,4 +166,61 @@ void PerlinNoise::get_buffer(float* buffer, size_t size, size_t octaves, float p
 }
 
 
+void NoiseLayerCache::get_buffer(float* buffer, size_t seed, size_t size, size_t octaves, float persistence) {
+    TITAN_TRACE_ZONE("NoiseLayerCache::get_buffer");
+    if (seed != cached_seed || size != cached_size) {
+        clear();
+        cached_seed = seed;
+        cached_size = size;
+    }
+
+    if (layers.size() < octaves) {
+        // Same grid as the first get_buffer call of a PerlinNoise with this seed
+        std::mt19937 random_engine(seed);
+        GradientGrid const grid = create_gradient_grid(1 << (octaves - 1), random_engine);
+        size_t const first_new = layers.size();
+        layers.resize(octaves);
+        for (size_t octave = first_new; octave < octaves; ++octave) {
+            auto& layer = layers[octave];
+            layer.resize(size * size);
+            float* const data = layer.data();
+            generate_octave(size, octave, grid, [data] (u64 const i, f32 const val) {
+                data[i] = 0.5f + 0.5f * val;
+            });
+        }
+        destroy_gradient_grid(grid);
+    }
+
+    // Weighted sum of the layers. Same order of operations as generate_noise, so the result is exactly the same
+    TITAN_TRACE_ZONE("sum noise layers");
+    size_t const count = size * size;
+    std::fill(buffer, buffer + count, 0.0f);
+    f32 amplitude = 1.0f;
+    for (size_t octave = 0; octave < octaves; ++octave) {
+        amplitude *= persistence;
+        float const* const layer = layers[octave].data();
+        for (size_t i = 0; i < count; ++i) {
+            buffer[i] += amplitude * layer[i];
+        }
+    }
+}
+
+std::vector<float> NoiseLayerCache::get_buffer_float(size_t seed, size_t size, size_t octaves, float persistence) {
+    std::vector<float> buffer(size * size);
+    get_buffer(buffer.data(), seed, size, octaves, persistence);
+    return buffer;
+}
+
+void NoiseLayerCache::clear() {
+    layers.clear();
+}
+
+size_t NoiseLayerCache::cached_octaves() const {
+    return layers.size();
+}
+
+size_t NoiseLayerCache::memory_usage() const {
+    return layers.size() * cached_size * cached_size * sizeof(float);
+}
+
 } // namespace titan
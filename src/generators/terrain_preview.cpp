@@ -0,0 +1,160 @@
+#include "generators/terrain_preview.hpp"
+#include "generators/noise.hpp"
+
+#include "math.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace titan {
+
+using namespace math;
+
+static size_t get_preview_size(HeightmapTerrainInfo const& info, TerrainPreviewInfo const& preview_info) {
+    size_t const size = std::min(preview_info.size, info.noise_size);
+    if (size < 2 || (size & (size - 1)) != 0) {
+        throw std::runtime_error("Terrain preview size must be a power of 2, got " + std::to_string(preview_info.size));
+    }
+    return size;
+}
+
+static size_t histogram_bin(float const value, float const max_value, size_t const bins) {
+    if (max_value <= 0.0f) { return 0; }
+    float const bin = value / max_value * bins;
+    return std::min((size_t)std::max(bin, 0.0f), bins - 1);
+}
+
+static void calculate_height_stats(TerrainPreview& preview, HeightmapTerrainInfo const& info,
+                                   TerrainPreviewInfo const& preview_info) {
+    float const max_possible = max_noise_height(info) * heightmap_noise_scale(info) * info.height_scale;
+
+    preview.height_histogram.assign(preview_info.height_bins, 0);
+    preview.min_height = std::numeric_limits<float>::max();
+    preview.max_height = std::numeric_limits<float>::lowest();
+    double sum = 0.0;
+    double sum_squared = 0.0;
+    for (float const value : preview.height_map) {
+        float const height = value * info.height_scale;
+        preview.min_height = std::min(preview.min_height, height);
+        preview.max_height = std::max(preview.max_height, height);
+        sum += height;
+        sum_squared += (double)height * height;
+        if (preview_info.height_bins != 0) {
+            ++preview.height_histogram[histogram_bin(height, max_possible, preview_info.height_bins)];
+        }
+    }
+
+    double const count = preview.height_map.size();
+    double const mean = sum / count;
+    preview.mean_height = mean;
+    preview.height_stddev = std::sqrt(std::max(sum_squared / count - mean * mean, 0.0));
+}
+
+static void calculate_slope_stats(TerrainPreview& preview, HeightmapTerrainInfo const& info,
+                                  TerrainPreviewInfo const& preview_info) {
+    size_t const size = preview.size;
+    // Worldspace distance between two texels
+    float const texel_x = info.width / size;
+    float const texel_y = info.length / size;
+    auto height_at = [&preview, &info, size] (size_t const x, size_t const y) {
+        return preview.height_map[index_2d(x, y, size)] * info.height_scale;
+    };
+
+    preview.slope_histogram.assign(preview_info.slope_bins, 0);
+    preview.max_slope = 0.0f;
+    double sum = 0.0;
+    for (size_t y = 0; y < size; ++y) {
+        // Central differences, one sided at the borders
+        size_t const y0 = y > 0 ? y - 1 : y;
+        size_t const y1 = y + 1 < size ? y + 1 : y;
+        for (size_t x = 0; x < size; ++x) {
+            size_t const x0 = x > 0 ? x - 1 : x;
+            size_t const x1 = x + 1 < size ? x + 1 : x;
+            float const dx = (height_at(x1, y) - height_at(x0, y)) / ((x1 - x0) * texel_x);
+            float const dy = (height_at(x, y1) - height_at(x, y0)) / ((y1 - y0) * texel_y);
+            float const slope = std::atan(std::sqrt(dx * dx + dy * dy)) * 180.0f / 3.14159265f;
+
+            preview.max_slope = std::max(preview.max_slope, slope);
+            sum += slope;
+            if (preview_info.slope_bins != 0) {
+                ++preview.slope_histogram[histogram_bin(slope, 90.0f, preview_info.slope_bins)];
+            }
+        }
+    }
+    preview.mean_slope = sum / (size * size);
+}
+
+TerrainPreview create_terrain_preview(HeightmapTerrainInfo const& info, TerrainPreviewInfo const& preview_info) {
+    TITAN_TRACE_ZONE("create_terrain_preview");
+    size_t const size = get_preview_size(info, preview_info);
+
+    TerrainPreview preview;
+    preview.seed = info.noise_seed;
+    preview.size = size;
+
+    PerlinNoise noise(info.noise_seed);
+    preview.height_map = noise.get_buffer_float(size, info.noise_layers, info.noise_persistence);
+    // Scaled like create_heightmap_terrain does
+    float const noise_scale = heightmap_noise_scale(info);
+    if (noise_scale != 1.0f) {
+        for (float& height : preview.height_map) {
+            height *= noise_scale;
+        }
+    }
+
+    calculate_height_stats(preview, info, preview_info);
+    calculate_slope_stats(preview, info, preview_info);
+    return preview;
+}
+
+std::vector<TerrainPreview> rank_terrain_seeds(HeightmapTerrainInfo const& info, std::vector<size_t> const& seeds,
+                                               TerrainPreviewInfo const& preview_info,
+                                               TerrainPreviewScore const& score) {
+    TITAN_TRACE_ZONE("rank_terrain_seeds");
+    std::vector<TerrainPreview> previews(seeds.size());
+    if (seeds.empty()) { return previews; }
+    // Throw here, an exception on a worker thread would terminate the program
+    get_preview_size(info, preview_info);
+
+    // Previews are small and cost about the same, so workers just take the next seed until all are done
+    std::atomic<size_t> next_seed = 0;
+    auto worker = [&] () {
+        TITAN_TRACE_THREAD_NAME("Terrain preview thread");
+        HeightmapTerrainInfo seed_info = info;
+        seed_info.noise_cache = nullptr;
+        for (size_t i = next_seed++; i < seeds.size(); i = next_seed++) {
+            seed_info.noise_seed = seeds[i];
+            TerrainPreview& preview = previews[i];
+            preview = create_terrain_preview(seed_info, preview_info);
+            preview.score = score ? score(preview) : preview.height_stddev;
+        }
+    };
+
+    size_t const cores = std::max(1u, std::thread::hardware_concurrency());
+    size_t const thread_count = std::min(preview_info.worker_count ? preview_info.worker_count : cores, seeds.size());
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads.emplace_back(worker);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // Stable, so seeds with the same score stay in the order they were passed in
+    std::stable_sort(previews.begin(), previews.end(), [] (TerrainPreview const& a, TerrainPreview const& b) {
+        return a.score > b.score;
+    });
+    if (preview_info.max_results != 0 && previews.size() > preview_info.max_results) {
+        previews.resize(preview_info.max_results);
+    }
+    return previews;
+}
+
+}
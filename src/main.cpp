@@ -1,10 +1,46 @@
 #include <iostream>
 #include <exception>
+#include <string>
 
 #include "example_app.hpp"
 
-int main() {
-    Application app(1280, 720);
-    app.run();
+static void print_usage(char const* program) {
+    std::cerr << "Usage: " << program << " [--benchmark [frames] [output path]]" << std::endl;
+}
 
-}
\ No newline at end of file
+// Only plain positive numbers, stoul would also take a sign or trailing garbage
+static bool parse_frame_count(std::string const& str, size_t& frames) {
+    if (str.empty() || str.find_first_not_of("0123456789") != std::string::npos) { return false; }
+    try {
+        frames = std::stoul(str);
+    } catch (std::exception const&) {
+        return false;
+    }
+    return frames > 0;
+}
+
+int main(int argc, char** argv) {
+    // --benchmark [frames] [output path] renders a fixed camera path offscreen and writes frame statistics
+    std::optional<BenchmarkOptions> benchmark;
+    if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+        benchmark = BenchmarkOptions{};
+        if (argc > 2 && !parse_frame_count(argv[2], benchmark->frames)) {
+            std::cerr << "Invalid frame count: " << argv[2] << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (argc > 3) { benchmark->output_path = argv[3]; }
+    } else if (argc > 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Failing to create a window or context, or a build without headless support, ends up here
+    try {
+        Application app(1280, 720, benchmark);
+        app.run();
+    } catch (std::exception const& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
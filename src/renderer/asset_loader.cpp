@@ -0,0 +1,342 @@
+#include "renderer/asset_loader.hpp"
+#include "renderer/gl_resource.hpp"
+#include "renderer/upload_pool.hpp"
+#include "renderer/util.hpp"
+#include "trace.hpp"
+
+#include <glad/glad.h>
+#include <stb/stb_image.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace titan::renderer {
+
+namespace {
+
+struct DecodedImage {
+    // Index into AssetLoader::assets and into the images of that asset
+    size_t asset = 0;
+    size_t face = 0;
+    size_t width = 0;
+    size_t height = 0;
+    size_t levels = 0;
+    // RGBA8, all mip levels after each other
+    std::vector<unsigned char> pixels;
+};
+
+// Header of a .ttex file, followed by the pixels of every level
+struct CacheHeader {
+    char magic[4] = {'T', 'T', 'E', 'X'};
+    std::uint32_t version = 1;
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    std::uint32_t levels = 0;
+};
+
+size_t level_bytes(size_t w, size_t h, size_t level) {
+    return std::max<size_t>(1, w >> level) * std::max<size_t>(1, h >> level) * 4;
+}
+
+size_t image_bytes(size_t w, size_t h, size_t levels) {
+    size_t bytes = 0;
+    for (size_t level = 0; level < levels; ++level) {
+        bytes += level_bytes(w, h, level);
+    }
+    return bytes;
+}
+
+// The cache entry changes whenever the source file does, so stale entries are simply never read again
+std::filesystem::path cache_path(std::string const& directory, AssetLoader::Image const& image, bool mipmapped) {
+    std::error_code error;
+    auto const size = std::filesystem::file_size(image.path, error);
+    auto const time = std::filesystem::last_write_time(image.path, error).time_since_epoch().count();
+    std::uint64_t hash = hash_string(image.path);
+    hash = hash_string(std::to_string(size) + " " + std::to_string(time) + " " + std::to_string(image.flip) + " " +
+                       std::to_string(mipmapped), hash);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.ttex", (unsigned long long)hash);
+    return std::filesystem::path(directory) / name;
+}
+
+bool read_cache(std::filesystem::path const& path, bool mipmapped, DecodedImage& image) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) { return false; }
+
+    CacheHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, CacheHeader{}.magic, 4) != 0 || header.version != CacheHeader{}.version ||
+        header.levels != (mipmapped ? mip_level_count(header.width, header.height) : 1)) {
+        return false;
+    }
+
+    image.width = header.width;
+    image.height = header.height;
+    image.levels = header.levels;
+    image.pixels.resize(image_bytes(image.width, image.height, image.levels));
+    file.read(reinterpret_cast<char*>(image.pixels.data()), image.pixels.size());
+    return (bool)file;
+}
+
+void write_cache(std::filesystem::path const& path, DecodedImage const& image) {
+    CacheHeader header;
+    header.width = image.width;
+    header.height = image.height;
+    header.levels = image.levels;
+    write_file_atomic(path, {{&header, sizeof(header)}, {image.pixels.data(), image.pixels.size()}});
+}
+
+// Appends every mip level after the first one, 2x2 box filtered
+void build_mips(DecodedImage& image) {
+    image.pixels.resize(image_bytes(image.width, image.height, image.levels));
+    unsigned char* src = image.pixels.data();
+    for (size_t level = 1; level < image.levels; ++level) {
+        size_t const src_w = std::max<size_t>(1, image.width >> (level - 1));
+        size_t const src_h = std::max<size_t>(1, image.height >> (level - 1));
+        size_t const dst_w = std::max<size_t>(1, src_w / 2);
+        size_t const dst_h = std::max<size_t>(1, src_h / 2);
+        unsigned char* dst = src + level_bytes(image.width, image.height, level - 1);
+        for (size_t y = 0; y < dst_h; ++y) {
+            size_t const y0 = std::min(2 * y, src_h - 1);
+            size_t const y1 = std::min(2 * y + 1, src_h - 1);
+            for (size_t x = 0; x < dst_w; ++x) {
+                size_t const x0 = std::min(2 * x, src_w - 1);
+                size_t const x1 = std::min(2 * x + 1, src_w - 1);
+                for (size_t c = 0; c < 4; ++c) {
+                    unsigned int const sum = src[(y0 * src_w + x0) * 4 + c] + src[(y0 * src_w + x1) * 4 + c] +
+                                             src[(y1 * src_w + x0) * 4 + c] + src[(y1 * src_w + x1) * 4 + c];
+                    dst[(y * dst_w + x) * 4 + c] = (sum + 2) / 4;
+                }
+            }
+        }
+        src = dst;
+    }
+}
+
+void flip_rows(unsigned char* pixels, size_t w, size_t h) {
+    size_t const row = w * 4;
+    std::vector<unsigned char> temp(row);
+    for (size_t y = 0; y < h / 2; ++y) {
+        unsigned char* top = pixels + y * row;
+        unsigned char* bottom = pixels + (h - 1 - y) * row;
+        std::memcpy(temp.data(), top, row);
+        std::memcpy(top, bottom, row);
+        std::memcpy(bottom, temp.data(), row);
+    }
+}
+
+// Runs on a worker thread
+bool decode_image(AssetLoader::Image const& source, bool mipmapped, std::string const& cache_directory, DecodedImage& image) {
+    TITAN_TRACE_ZONE("decode image");
+    std::filesystem::path cache;
+    if (!cache_directory.empty()) {
+        cache = cache_path(cache_directory, source, mipmapped);
+        if (read_cache(cache, mipmapped, image)) { return true; }
+    }
+
+    int w, h, channels;
+    unsigned char* data = stbi_load(source.path.c_str(), &w, &h, &channels, 4);
+    if (!data) { return false; }
+
+    image.width = w;
+    image.height = h;
+    image.levels = mipmapped ? mip_level_count(w, h) : 1;
+    image.pixels.resize(image_bytes(w, h, image.levels));
+    std::memcpy(image.pixels.data(), data, level_bytes(w, h, 0));
+    stbi_image_free(data);
+
+    // Flipped here instead of with stbi_set_flip_vertically_on_load, that is global state shared by all workers
+    if (source.flip) {
+        flip_rows(image.pixels.data(), image.width, image.height);
+    }
+    build_mips(image);
+
+    if (!cache.empty()) {
+        write_cache(cache, image);
+    }
+    return true;
+}
+
+// Copies the image into a pixel buffer object and starts the transfer into the texture from there, so the driver can
+// do the transfer asynchronously instead of copying from our memory before returning
+void upload_image(unsigned int texture, DecodedImage const& image, bool cubemap) {
+    TITAN_TRACE_ZONE("upload image");
+    unsigned int pbo;
+    glCreateBuffers(1, &pbo);
+    glNamedBufferStorage(pbo, image.pixels.size(), nullptr, GL_MAP_WRITE_BIT);
+    void* mapped = glMapNamedBufferRange(pbo, 0, image.pixels.size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    UploadPool::stream_copy(mapped, image.pixels.data(), image.pixels.size());
+    glUnmapNamedBuffer(pbo);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    size_t offset = 0;
+    for (size_t level = 0; level < image.levels; ++level) {
+        size_t const w = std::max<size_t>(1, image.width >> level);
+        size_t const h = std::max<size_t>(1, image.height >> level);
+        void const* pixels = reinterpret_cast<void const*>(offset);
+        if (cubemap) {
+            glTextureSubImage3D(texture, level, 0, 0, image.face, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        } else {
+            glTextureSubImage2D(texture, level, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        }
+        offset += level_bytes(image.width, image.height, level);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    // The transfer may still be reading from the buffer
+    DeletionQueue::push(GLObjectType::Buffer, pbo);
+}
+
+unsigned int create_texture(DecodedImage const& image, bool cubemap) {
+    unsigned int texture;
+    if (cubemap) {
+        glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &texture);
+        glTextureStorage2D(texture, 1, GL_RGBA8, image.width, image.height);
+        glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    } else {
+        glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+        glTextureStorage2D(texture, image.levels, GL_RGBA8, image.width, image.height);
+        glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    }
+    return texture;
+}
+
+}
+
+size_t add_texture(AssetLoader& loader, std::string const& path) {
+    AssetLoader::Asset asset;
+    asset.images.push_back({path, true});
+    loader.assets.push_back(std::move(asset));
+    return loader.assets.size() - 1;
+}
+
+size_t add_cubemap(AssetLoader& loader, std::string const& descriptor_path) {
+    AssetLoader::Asset asset;
+    asset.cubemap = true;
+    std::ifstream paths(descriptor_path);
+    if (paths.good()) {
+        for (size_t face = 0; face < 6; ++face) {
+            std::string path;
+            std::string flip;
+            paths >> path;
+            paths >> flip;
+            asset.images.push_back({path, flip == "true"});
+        }
+    }
+    loader.assets.push_back(std::move(asset));
+    return loader.assets.size() - 1;
+}
+
+std::vector<GLTexture> load_assets(AssetLoader& loader) {
+    TITAN_TRACE_ZONE("load_assets");
+    struct Job {
+        size_t asset;
+        size_t face;
+    };
+    std::vector<Job> jobs;
+    for (size_t asset = 0; asset < loader.assets.size(); ++asset) {
+        for (size_t face = 0; face < loader.assets[asset].images.size(); ++face) {
+            jobs.push_back({asset, face});
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable decoded_cv;
+    // Decoded images waiting for upload. Images that could not be loaded have 0 levels
+    std::deque<DecodedImage> decoded;
+    std::atomic<size_t> next_job = 0;
+
+    auto worker = [&] () {
+        TITAN_TRACE_THREAD_NAME("Asset worker");
+        for (size_t index = next_job++; index < jobs.size(); index = next_job++) {
+            Job const job = jobs[index];
+            AssetLoader::Asset const& asset = loader.assets[job.asset];
+            DecodedImage image;
+            // Cubemaps are sampled without mipmaps, like load_cubemap does
+            if (!decode_image(asset.images[job.face], !asset.cubemap, loader.info.cache_directory, image)) {
+                image = DecodedImage{};
+            }
+            image.asset = job.asset;
+            image.face = job.face;
+
+            std::lock_guard lock(mutex);
+            decoded.push_back(std::move(image));
+            decoded_cv.notify_one();
+        }
+    };
+
+    // Workers flip rows themselves. stbi_load would flip them too if load_texture or load_cubemap left this set
+    stbi_set_flip_vertically_on_load(false);
+
+    size_t const cores = std::max(1u, std::thread::hardware_concurrency());
+    size_t const thread_count = std::min(loader.info.worker_count ? loader.info.worker_count : cores, jobs.size());
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads.emplace_back(worker);
+    }
+
+    std::vector<GLTexture> textures(loader.assets.size());
+    std::vector<unsigned char> failed(loader.assets.size(), false);
+    for (size_t uploaded = 0; uploaded < jobs.size(); ++uploaded) {
+        DecodedImage image;
+        {
+            std::unique_lock lock(mutex);
+            decoded_cv.wait(lock, [&decoded] () { return !decoded.empty(); });
+            image = std::move(decoded.front());
+            decoded.pop_front();
+        }
+
+        AssetLoader::Asset const& asset = loader.assets[image.asset];
+        if (image.levels == 0) {
+            std::cout << "Could not load image " << asset.images[image.face].path << std::endl;
+            failed[image.asset] = true;
+            continue;
+        }
+        GLTexture& texture_object = textures[image.asset];
+        if (!texture_object) {
+            texture_object = GLTexture(create_texture(image, asset.cubemap));
+        }
+        unsigned int const texture = texture_object.get();
+        // Every face of a cubemap uses the size of the face that finished decoding first
+        GLint width, height;
+        glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_HEIGHT, &height);
+        if ((size_t)width != image.width || (size_t)height != image.height) {
+            std::cout << "Cubemap face " << asset.images[image.face].path << " has a different size than the other faces" << std::endl;
+            failed[image.asset] = true;
+            continue;
+        }
+        upload_image(texture, image, asset.cubemap);
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (size_t asset = 0; asset < textures.size(); ++asset) {
+        if (failed[asset]) {
+            textures[asset].reset();
+        }
+    }
+    loader.assets.clear();
+    return textures;
+}
+
+}
@@ -0,0 +1,194 @@
+#include "renderer/buffer_pool.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace titan::renderer {
+
+// Vertex attribute offsets and index offsets need some alignment, 256 bytes covers everything
+static constexpr size_t block_alignment = 256;
+// Target size of a single slab. Big blocks get at least one block per slab
+static constexpr size_t slab_target_size = 8 * 1024 * 1024;
+
+BufferPool::BufferPool(BufferPool&& rhs)
+    : size_classes(std::exchange(rhs.size_classes, {})),
+      pending_frees(std::exchange(rhs.pending_frees, {})),
+      used_bytes(std::exchange(rhs.used_bytes, 0)),
+      max_bytes(std::exchange(rhs.max_bytes, 0)) {}
+
+BufferPool& BufferPool::operator=(BufferPool&& rhs) {
+    if (this != &rhs) {
+        // The slabs are released by the GLBuffer assignments, the fences would leak
+        delete_pending_fences();
+        size_classes = std::exchange(rhs.size_classes, {});
+        pending_frees = std::exchange(rhs.pending_frees, {});
+        used_bytes = std::exchange(rhs.used_bytes, 0);
+        max_bytes = std::exchange(rhs.max_bytes, 0);
+    }
+    return *this;
+}
+
+BufferPool::~BufferPool() {
+    delete_pending_fences();
+}
+
+void BufferPool::delete_pending_fences() {
+    for (auto& pending : pending_frees) {
+        glDeleteSync(static_cast<GLsync>(pending.fence));
+    }
+    pending_frees.clear();
+}
+
+void BufferPool::create(std::vector<size_t> const& block_sizes, size_t budget) {
+    max_bytes = budget;
+    size_classes.resize(block_sizes.size());
+    for (size_t i = 0; i < block_sizes.size(); ++i) {
+        auto& size_class = size_classes[i];
+        size_class.block_size = (block_sizes[i] + block_alignment - 1) & ~(block_alignment - 1);
+        size_class.blocks_per_slab = std::max<size_t>(1, slab_target_size / size_class.block_size);
+    }
+}
+
+void BufferPool::create_slab(SizeClass& size_class, Slab& slab) {
+    size_t const slab_size = size_class.block_size * size_class.blocks_per_slab;
+    constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT;
+    slab.buffer = make_buffer();
+    glNamedBufferStorage(slab.buffer.get(), slab_size, nullptr, flags);
+    slab.mapped = glMapNamedBufferRange(slab.buffer.get(), 0, slab_size, flags | GL_MAP_FLUSH_EXPLICIT_BIT);
+    slab.used = 0;
+    slab.free_blocks.resize(size_class.blocks_per_slab);
+    // Reversed, so blocks are handed out front to back
+    for (size_t i = 0; i < size_class.blocks_per_slab; ++i) {
+        slab.free_blocks[i] = size_class.blocks_per_slab - i - 1;
+    }
+}
+
+bool BufferPool::reserve(size_t const size_class_index, size_t const blocks) {
+    auto& size_class = size_classes[size_class_index];
+    size_t free_blocks = 0;
+    for (auto const& slab : size_class.slabs) {
+        if (slab.buffer) { free_blocks += slab.free_blocks.size(); }
+    }
+    if (free_blocks >= blocks) { return true; }
+
+    auto released = std::find_if(size_class.slabs.begin(), size_class.slabs.end(), [](Slab const& slab) { return !slab.buffer; });
+    if (released == size_class.slabs.end()) {
+        size_class.slabs.emplace_back();
+        released = size_class.slabs.end() - 1;
+    }
+    create_slab(size_class, *released);
+    return false;
+}
+
+BufferPool::Allocation BufferPool::allocate(size_t const size_class_index) {
+    auto& size_class = size_classes[size_class_index];
+
+    // Find a slab with a free block. Prefer slabs that are already in use, so empty slabs can be released
+    size_t slab_index = size_class.slabs.size();
+    for (size_t i = 0; i < size_class.slabs.size(); ++i) {
+        auto const& slab = size_class.slabs[i];
+        if (!slab.buffer || slab.free_blocks.empty()) { continue; }
+        if (slab_index == size_class.slabs.size() || slab.used > size_class.slabs[slab_index].used) {
+            slab_index = i;
+        }
+    }
+
+    if (slab_index == size_class.slabs.size()) {
+        // Reuse the slot of a released slab if there is one
+        auto released = std::find_if(size_class.slabs.begin(), size_class.slabs.end(),
+                                     [](Slab const& slab) { return !slab.buffer; });
+        slab_index = released - size_class.slabs.begin();
+        if (released == size_class.slabs.end()) {
+            size_class.slabs.emplace_back();
+        }
+        create_slab(size_class, size_class.slabs[slab_index]);
+    }
+
+    auto& slab = size_class.slabs[slab_index];
+    size_t const block = slab.free_blocks.back();
+    slab.free_blocks.pop_back();
+    ++slab.used;
+    used_bytes += size_class.block_size;
+
+    Allocation allocation;
+    allocation.buffer = slab.buffer.get();
+    allocation.offset = block * size_class.block_size;
+    allocation.mapped = static_cast<unsigned char*>(slab.mapped) + allocation.offset;
+    allocation.size_class = size_class_index;
+    allocation.slab = slab_index;
+    allocation.block = block;
+    return allocation;
+}
+
+void BufferPool::free(Allocation& allocation) {
+    if (allocation.size_class == no_size_class) { return; }
+
+    used_bytes -= size_classes[allocation.size_class].block_size;
+    // The GPU may still be reading from this block for a frame or two
+    pending_frees.push_back(PendingFree{allocation, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+    allocation = Allocation{};
+}
+
+void BufferPool::collect() {
+    // Fences signal in order, so we can stop at the first one that didn't signal yet
+    size_t done = 0;
+    for (; done < pending_frees.size(); ++done) {
+        GLsync const fence = static_cast<GLsync>(pending_frees[done].fence);
+        GLenum const status = glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) { break; }
+        glDeleteSync(fence);
+
+        auto const& allocation = pending_frees[done].allocation;
+        auto& slab = size_classes[allocation.size_class].slabs[allocation.slab];
+        slab.free_blocks.push_back(allocation.block);
+        --slab.used;
+    }
+    pending_frees.erase(pending_frees.begin(), pending_frees.begin() + done);
+
+    // Release empty slabs, but keep one around per size class to avoid creating and deleting a slab every frame
+    for (auto& size_class : size_classes) {
+        bool kept_empty = false;
+        for (auto& slab : size_class.slabs) {
+            if (!slab.buffer || slab.used != 0) { continue; }
+            if (!kept_empty) {
+                kept_empty = true;
+                continue;
+            }
+            // Queues the buffer for deletion
+            slab = Slab{};
+        }
+    }
+}
+
+bool BufferPool::over_budget() const {
+    return used_bytes > max_bytes;
+}
+
+size_t BufferPool::bytes_used() const {
+    return used_bytes;
+}
+
+size_t BufferPool::budget() const {
+    return max_bytes;
+}
+
+std::vector<BufferPool::SizeClassUsage> BufferPool::usage() const {
+    std::vector<SizeClassUsage> result(size_classes.size());
+    for (size_t i = 0; i < size_classes.size(); ++i) {
+        auto const& size_class = size_classes[i];
+        auto& usage = result[i];
+        usage.block_size = size_class.block_size;
+        for (auto const& slab : size_class.slabs) {
+            if (!slab.buffer) { continue; }
+            usage.blocks_used += slab.used;
+            usage.blocks_reserved += size_class.blocks_per_slab;
+        }
+        usage.bytes_used = usage.blocks_used * usage.block_size;
+        usage.bytes_reserved = usage.blocks_reserved * usage.block_size;
+    }
+    return result;
+}
+
+}
\ No newline at end of file
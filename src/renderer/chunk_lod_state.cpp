@@ -0,0 +1,107 @@
+#include "renderer/chunk_lod_state.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define TITAN_LOD_SSE 1
+    #include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace titan::renderer {
+
+void resize_chunk_lod_state(ChunkLODState& state, size_t count) {
+    size_t const padded = (count + 3) & ~size_t(3);
+    state.count = count;
+    state.local_x.resize(padded, 0);
+    state.local_y.resize(padded, 0);
+    state.local_z.resize(padded, 0);
+    state.world_x.resize(padded, 0);
+    state.world_y.resize(padded, 0);
+    state.world_z.resize(padded, 0);
+    state.distance.resize(padded, 0);
+    state.current_lod.resize(padded, 0);
+    state.target_lod.resize(padded, 0);
+    // Centers changed, so the world space centers have to be recalculated
+    state.has_transform = false;
+}
+
+void set_chunk_center(ChunkLODState& state, size_t index, float const* center) {
+    state.local_x[index] = center[0];
+    state.local_y[index] = center[1];
+    state.local_z[index] = center[2];
+    state.has_transform = false;
+}
+
+bool set_chunk_transform(ChunkLODState& state, glm::mat4 const& m) {
+    if (state.has_transform && std::memcmp(&state.transform, &m, sizeof(glm::mat4)) == 0) { return false; }
+    state.transform = m;
+    state.has_transform = true;
+
+    // Centers are points, so the translation column applies
+    for (size_t i = 0; i < state.count; ++i) {
+        float const x = state.local_x[i];
+        float const y = state.local_y[i];
+        float const z = state.local_z[i];
+        state.world_x[i] = m[0][0] * x + m[1][0] * y + m[2][0] * z + m[3][0];
+        state.world_y[i] = m[0][1] * x + m[1][1] * y + m[2][1] * z + m[3][1];
+        state.world_z[i] = m[0][2] * x + m[1][2] * y + m[2][2] * z + m[3][2];
+    }
+    return true;
+}
+
+float calculate_chunk_distance(ChunkLODState const& state, size_t index, float const* cam_pos) {
+    float const dx = state.world_x[index] - cam_pos[0];
+    float const dy = state.world_y[index] - cam_pos[1];
+    float const dz = state.world_z[index] - cam_pos[2];
+    return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+void calculate_chunk_distances(ChunkLODState& state, float const* cam_pos) {
+    size_t const padded = state.distance.size();
+#if TITAN_LOD_SSE
+    __m128 const cx = _mm_set1_ps(cam_pos[0]);
+    __m128 const cy = _mm_set1_ps(cam_pos[1]);
+    __m128 const cz = _mm_set1_ps(cam_pos[2]);
+    for (size_t i = 0; i < padded; i += 4) {
+        __m128 const dx = _mm_sub_ps(_mm_loadu_ps(&state.world_x[i]), cx);
+        __m128 const dy = _mm_sub_ps(_mm_loadu_ps(&state.world_y[i]), cy);
+        __m128 const dz = _mm_sub_ps(_mm_loadu_ps(&state.world_z[i]), cz);
+        __m128 const sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        _mm_storeu_ps(&state.distance[i], _mm_sqrt_ps(sq));
+    }
+#else
+    for (size_t i = 0; i < padded; ++i) {
+        float const dx = state.world_x[i] - cam_pos[0];
+        float const dy = state.world_y[i] - cam_pos[1];
+        float const dz = state.world_z[i] - cam_pos[2];
+        state.distance[i] = std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+#endif
+}
+
+void calculate_distance_lods(ChunkLODState& state, float near_distance, float far_distance, size_t lod_count) {
+    size_t const padded = state.distance.size();
+    float const scale = (float)lod_count / (far_distance - near_distance);
+    // Clamping before truncating gives the same result as clamping the integer LOD, since the value is never negative
+    float const max_lod = (float)(lod_count - 1);
+#if TITAN_LOD_SSE
+    __m128 const near_v = _mm_set1_ps(near_distance);
+    __m128 const scale_v = _mm_set1_ps(scale);
+    __m128 const zero = _mm_setzero_ps();
+    __m128 const max_v = _mm_set1_ps(max_lod);
+    for (size_t i = 0; i < padded; i += 4) {
+        __m128 lod = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&state.distance[i]), near_v), scale_v);
+        lod = _mm_min_ps(_mm_max_ps(lod, zero), max_v);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&state.target_lod[i]), _mm_cvttps_epi32(lod));
+    }
+#else
+    for (size_t i = 0; i < padded; ++i) {
+        float const lod = std::clamp((state.distance[i] - near_distance) * scale, 0.0f, max_lod);
+        state.target_lod[i] = (std::uint32_t)lod;
+    }
+#endif
+}
+
+}
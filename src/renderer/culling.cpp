@@ -0,0 +1,115 @@
+#include "renderer/culling.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define TITAN_CULLING_SSE 1
+    #include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+
+namespace titan::renderer {
+
+Frustum make_frustum(glm::mat4 const& m) {
+    // Gribb-Hartmann plane extraction. glm matrices are column major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+    Frustum frustum;
+    for (int i = 0; i < 3; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            // Left, bottom, near
+            frustum.planes[2 * i][c] = m[c][3] + m[c][i];
+            // Right, top, far
+            frustum.planes[2 * i + 1][c] = m[c][3] - m[c][i];
+        }
+    }
+    return frustum;
+}
+
+void resize_chunk_bounds(ChunkBounds& bounds, size_t count) {
+    size_t const padded = (count + 3) & ~size_t(3);
+    bounds.count = count;
+    // The results for the padding boxes are ignored
+    bounds.center_x.resize(padded, 0);
+    bounds.center_y.resize(padded, 0);
+    bounds.center_z.resize(padded, 0);
+    bounds.extent_x.resize(padded, 0);
+    bounds.extent_y.resize(padded, 0);
+    bounds.extent_z.resize(padded, 0);
+}
+
+void set_chunk_bounds(ChunkBounds& bounds, size_t index, float const* min, float const* max) {
+    bounds.center_x[index] = (min[0] + max[0]) / 2.0f;
+    bounds.center_y[index] = (min[1] + max[1]) / 2.0f;
+    bounds.center_z[index] = (min[2] + max[2]) / 2.0f;
+    bounds.extent_x[index] = (max[0] - min[0]) / 2.0f;
+    bounds.extent_y[index] = (max[1] - min[1]) / 2.0f;
+    bounds.extent_z[index] = (max[2] - min[2]) / 2.0f;
+}
+
+#if TITAN_CULLING_SSE
+
+// Tests 4 boxes against all planes. Returns a bitmask with a bit set for every box that is (partially) inside
+static int cull_4(Frustum const& frustum, ChunkBounds const& bounds, size_t first) {
+    __m128 const cx = _mm_loadu_ps(&bounds.center_x[first]);
+    __m128 const cy = _mm_loadu_ps(&bounds.center_y[first]);
+    __m128 const cz = _mm_loadu_ps(&bounds.center_z[first]);
+    __m128 const ex = _mm_loadu_ps(&bounds.extent_x[first]);
+    __m128 const ey = _mm_loadu_ps(&bounds.extent_y[first]);
+    __m128 const ez = _mm_loadu_ps(&bounds.extent_z[first]);
+
+    __m128 const sign_mask = _mm_set1_ps(-0.0f);
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (auto const& plane : frustum.planes) {
+        __m128 const nx = _mm_set1_ps(plane[0]);
+        __m128 const ny = _mm_set1_ps(plane[1]);
+        __m128 const nz = _mm_set1_ps(plane[2]);
+        // Signed distance of the center to the plane
+        __m128 dist = _mm_add_ps(_mm_mul_ps(nx, cx), _mm_set1_ps(plane[3]));
+        dist = _mm_add_ps(dist, _mm_mul_ps(ny, cy));
+        dist = _mm_add_ps(dist, _mm_mul_ps(nz, cz));
+        // Projected radius of the box onto the plane normal
+        __m128 radius = _mm_mul_ps(_mm_andnot_ps(sign_mask, nx), ex);
+        radius = _mm_add_ps(radius, _mm_mul_ps(_mm_andnot_ps(sign_mask, ny), ey));
+        radius = _mm_add_ps(radius, _mm_mul_ps(_mm_andnot_ps(sign_mask, nz), ez));
+        // The box is outside as soon as it is fully behind one plane
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(dist, radius), _mm_setzero_ps()));
+    }
+    return _mm_movemask_ps(inside);
+}
+
+#else
+
+static int cull_4(Frustum const& frustum, ChunkBounds const& bounds, size_t first) {
+    int mask = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        size_t const index = first + i;
+        bool inside = true;
+        for (auto const& plane : frustum.planes) {
+            float const dist = plane[0] * bounds.center_x[index] + plane[1] * bounds.center_y[index]
+                             + plane[2] * bounds.center_z[index] + plane[3];
+            float const radius = std::abs(plane[0]) * bounds.extent_x[index] + std::abs(plane[1]) * bounds.extent_y[index]
+                               + std::abs(plane[2]) * bounds.extent_z[index];
+            inside = inside && (dist + radius >= 0);
+        }
+        mask |= (int)inside << i;
+    }
+    return mask;
+}
+
+#endif
+
+CullStats cull_chunks(Frustum const& frustum, ChunkBounds const& bounds, std::vector<unsigned char>& visible) {
+    CullStats stats;
+    visible.resize(bounds.count);
+    for (size_t first = 0; first < bounds.count; first += 4) {
+        int const mask = cull_4(frustum, bounds, first);
+        size_t const last = std::min(first + 4, bounds.count);
+        for (size_t i = first; i < last; ++i) {
+            visible[i] = (mask >> (i - first)) & 1;
+            stats.visible += visible[i];
+        }
+    }
+    stats.culled = bounds.count - stats.visible;
+    return stats;
+}
+
+}
\ No newline at end of file
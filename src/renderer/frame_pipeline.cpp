@@ -0,0 +1,156 @@
+#include "renderer/frame_pipeline.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace titan::renderer {
+
+// Prepare stage, CPU only. Reads nothing from info that the GL thread changes after creation
+static void prepare_frame(FramePipeline& pipeline, FrameInput const& input, PreparedFrame& frame) {
+    TITAN_TRACE_ZONE("prepare_frame");
+    auto const& info = *pipeline.info;
+    auto const& terrain = *pipeline.terrain;
+    size_t const chunk_count = terrain.mesh.chunks.size();
+    frame.input = input;
+
+    // Cull first, so we don't pick LODs for chunks we can't see
+    frame.cull_stats = cull_chunks(make_frustum(input.projection * input.view * input.terrain_transform), info.bounds, frame.visible);
+    // Occluder boxes are in terrain space
+    glm::vec4 const cam = glm::inverse(input.terrain_transform) * glm::vec4(input.cam_pos, 1);
+    float const cam_heightfield[3] = {cam.x, cam.y, -cam.z};
+    frame.occlusion_stats = occlude_chunks(pipeline.occluder, info.occluder_boxes, cam_heightfield, frame.visible);
+
+    auto& state = pipeline.lod_state;
+    set_chunk_transform(state, input.terrain_transform);
+    calculate_chunk_distances(state, glm::value_ptr(input.cam_pos));
+    frame.distance.assign(state.distance.begin(), state.distance.begin() + chunk_count);
+
+    if (pipeline.triangle_budget != 0) {
+        frame.budget_triangles = allocate_triangle_budget(terrain, frame.visible, frame.distance, pipeline.triangle_budget,
+                                                          pipeline.lod_selection, frame.target_lods);
+    } else {
+        frame.target_lods.assign(chunk_count, TerrainRenderInfo::no_lod);
+        for (size_t chunk_id = 0; chunk_id < chunk_count; ++chunk_id) {
+            if (!frame.visible[chunk_id]) { continue; }
+            frame.target_lods[chunk_id] = lod_from_screen_space_error(terrain.mesh.chunks[chunk_id], frame.distance[chunk_id],
+                                                                      pipeline.current_lods[chunk_id], pipeline.lod_selection);
+        }
+    }
+
+    // Only chunks that are staying at their LOD are prefetched for, the others already use their neighbour buffers
+    frame.prefetch_lods.assign(chunk_count, TerrainRenderInfo::no_lod);
+    for (size_t chunk_id = 0; chunk_id < chunk_count; ++chunk_id) {
+        size_t const current_lod = pipeline.current_lods[chunk_id];
+        if (!frame.visible[chunk_id] || frame.target_lods[chunk_id] != current_lod) { continue; }
+        float const distance = calculate_chunk_distance(state, chunk_id, glm::value_ptr(input.predicted_pos));
+        size_t const lod = lod_from_screen_space_error(terrain.mesh.chunks[chunk_id], distance, current_lod, pipeline.lod_selection);
+        if (lod != current_lod) {
+            frame.prefetch_lods[chunk_id] = lod;
+        }
+    }
+
+    frame.draw_list.clear();
+    for (size_t chunk_id = 0; chunk_id < chunk_count; ++chunk_id) {
+        if (frame.visible[chunk_id]) { frame.draw_list.push_back(chunk_id); }
+    }
+    std::sort(frame.draw_list.begin(), frame.draw_list.end(), [&frame] (std::uint32_t a, std::uint32_t b) {
+        return frame.distance[a] < frame.distance[b];
+    });
+}
+
+static void worker_main(FramePipeline* pipeline) {
+    TITAN_TRACE_THREAD_NAME("Prepare thread");
+    std::unique_lock lock(pipeline->mutex);
+    while (true) {
+        pipeline->cv.wait(lock, [pipeline] () { return pipeline->busy || pipeline->quit; });
+        if (pipeline->quit) { return; }
+
+        // The GL thread doesn't touch the pipeline until busy is false again, so this doesn't need the lock
+        lock.unlock();
+        prepare_frame(*pipeline, pipeline->input, pipeline->frames[pipeline->next_frame]);
+        lock.lock();
+
+        pipeline->busy = false;
+        pipeline->cv.notify_all();
+    }
+}
+
+FramePipeline::~FramePipeline() {
+    destroy_frame_pipeline(*this);
+}
+
+void create_frame_pipeline(FramePipeline& pipeline, TerrainRenderInfo const& info, HeightmapTerrain const& terrain,
+                           LODSelectionParams const& lod_selection, size_t triangle_budget) {
+    pipeline.info = &info;
+    pipeline.terrain = &terrain;
+    pipeline.lod_selection = lod_selection;
+    pipeline.triangle_budget = triangle_budget;
+
+    // Copy of the chunk centers, the worker keeps its own worldspace centers and distances
+    size_t const chunk_count = terrain.mesh.chunks.size();
+    resize_chunk_lod_state(pipeline.lod_state, chunk_count);
+    for (size_t i = 0; i < chunk_count; ++i) {
+        float const center[3] = {info.lod_state.local_x[i], info.lod_state.local_y[i], info.lod_state.local_z[i]};
+        set_chunk_center(pipeline.lod_state, i, center);
+    }
+    pipeline.current_lods.resize(chunk_count);
+
+    pipeline.worker = std::thread(worker_main, &pipeline);
+}
+
+void destroy_frame_pipeline(FramePipeline& pipeline) {
+    {
+        std::lock_guard lock(pipeline.mutex);
+        pipeline.quit = true;
+    }
+    pipeline.cv.notify_all();
+    if (pipeline.worker.joinable()) {
+        pipeline.worker.join();
+    }
+    // Back to the initial state, so the pipeline can be created again for another terrain
+    pipeline.quit = false;
+    pipeline.busy = false;
+    pipeline.started = false;
+    pipeline.next_frame = 0;
+}
+
+static void snapshot_current_lods(FramePipeline& pipeline, TerrainRenderInfo const& info) {
+    for (size_t i = 0; i < pipeline.current_lods.size(); ++i) {
+        pipeline.current_lods[i] = info.chunks[i].current_lod.lod;
+    }
+}
+
+PreparedFrame const& advance_frame_pipeline(FramePipeline& pipeline, TerrainRenderInfo const& info, FrameInput const& input) {
+    TITAN_TRACE_ZONE("advance_frame_pipeline");
+    std::unique_lock lock(pipeline.mutex);
+    if (!pipeline.started) {
+        // Nothing was prepared yet, so do this one here to have something to submit
+        snapshot_current_lods(pipeline, info);
+        prepare_frame(pipeline, input, pipeline.frames[pipeline.next_frame]);
+        pipeline.started = true;
+    } else {
+        pipeline.cv.wait(lock, [&pipeline] () { return !pipeline.busy; });
+    }
+
+    snapshot_current_lods(pipeline, info);
+    size_t const finished = pipeline.next_frame;
+    pipeline.next_frame = 1 - finished;
+    pipeline.input = input;
+    pipeline.busy = true;
+    pipeline.cv.notify_all();
+    return pipeline.frames[finished];
+}
+
+DrawStats submit_prepared_frame(TerrainRenderInfo& info, HeightmapTerrain const& terrain, PreparedFrame const& frame) {
+    TITAN_TRACE_ZONE("submit_prepared_frame");
+    info.visible = frame.visible;
+    info.cull_stats = frame.cull_stats;
+    info.occlusion_stats = frame.occlusion_stats;
+    info.budget_triangles = frame.budget_triangles;
+
+    apply_lod_targets(info, terrain, frame.distance, frame.target_lods, frame.prefetch_lods);
+    return render_terrain(info, frame.draw_list);
+}
+
+}
@@ -0,0 +1,128 @@
+#include "renderer/gl_resource.hpp"
+#include "renderer/gl_state.hpp"
+
+#include <glad/glad.h>
+
+#include <deque>
+#include <vector>
+
+namespace titan::renderer {
+
+namespace {
+
+struct Objects {
+    std::vector<unsigned int> buffers;
+    std::vector<unsigned int> textures;
+    std::vector<unsigned int> vertex_arrays;
+
+    size_t size() const {
+        return buffers.size() + textures.size() + vertex_arrays.size();
+    }
+};
+
+struct Batch {
+    Objects objects;
+    GLsync fence;
+};
+
+struct Queue {
+    // Queued during the current frame, not fenced yet
+    Objects unfenced;
+    // Oldest frame first. Fences signal in order, so only the front has to be checked
+    std::deque<Batch> batches;
+    size_t pending = 0;
+    size_t deleted = 0;
+};
+
+Queue& get_queue() {
+    static Queue queue;
+    return queue;
+}
+
+void delete_objects(Objects& objects) {
+    // Forget first, GL may hand out the same names again right after deleting
+    for (unsigned int buffer : objects.buffers) { GLStateCache::forget_buffer(buffer); }
+    for (unsigned int texture : objects.textures) { GLStateCache::forget_texture(texture); }
+    for (unsigned int vao : objects.vertex_arrays) { GLStateCache::forget_vertex_array(vao); }
+
+    if (!objects.buffers.empty()) { glDeleteBuffers(objects.buffers.size(), objects.buffers.data()); }
+    if (!objects.textures.empty()) { glDeleteTextures(objects.textures.size(), objects.textures.data()); }
+    if (!objects.vertex_arrays.empty()) { glDeleteVertexArrays(objects.vertex_arrays.size(), objects.vertex_arrays.data()); }
+
+    auto& queue = get_queue();
+    size_t const count = objects.size();
+    queue.pending -= count;
+    queue.deleted += count;
+    objects = Objects{};
+}
+
+}
+
+void DeletionQueue::push(GLObjectType type, unsigned int name) {
+    if (name == 0) { return; }
+
+    auto& queue = get_queue();
+    switch (type) {
+        case GLObjectType::Buffer: queue.unfenced.buffers.push_back(name); break;
+        case GLObjectType::Texture: queue.unfenced.textures.push_back(name); break;
+        case GLObjectType::VertexArray: queue.unfenced.vertex_arrays.push_back(name); break;
+    }
+    ++queue.pending;
+}
+
+void DeletionQueue::end_frame() {
+    auto& queue = get_queue();
+    if (queue.unfenced.size() != 0) {
+        queue.batches.push_back(Batch{std::move(queue.unfenced), glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+        queue.unfenced = Objects{};
+    }
+
+    while (!queue.batches.empty()) {
+        auto& batch = queue.batches.front();
+        // Timeout of 0 only checks the status of the fence
+        GLenum const status = glClientWaitSync(batch.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) { break; }
+        glDeleteSync(batch.fence);
+        delete_objects(batch.objects);
+        queue.batches.pop_front();
+    }
+}
+
+void DeletionQueue::flush() {
+    auto& queue = get_queue();
+    glFinish();
+    for (auto& batch : queue.batches) {
+        glDeleteSync(batch.fence);
+        delete_objects(batch.objects);
+    }
+    queue.batches.clear();
+    delete_objects(queue.unfenced);
+}
+
+size_t DeletionQueue::pending() {
+    return get_queue().pending;
+}
+
+size_t DeletionQueue::deleted() {
+    return get_queue().deleted;
+}
+
+GLBuffer make_buffer() {
+    unsigned int buffer;
+    glCreateBuffers(1, &buffer);
+    return GLBuffer(buffer);
+}
+
+GLTexture make_texture(unsigned int target) {
+    unsigned int texture;
+    glCreateTextures(target, 1, &texture);
+    return GLTexture(texture);
+}
+
+GLVertexArray make_vertex_array() {
+    unsigned int vao;
+    glCreateVertexArrays(1, &vao);
+    return GLVertexArray(vao);
+}
+
+}
@@ -0,0 +1,140 @@
+#include "renderer/gl_state.hpp"
+
+#include <glad/glad.h>
+
+#include <unordered_map>
+
+namespace titan::renderer {
+
+namespace {
+
+// Value for state we don't know, so the next bind is always issued
+constexpr unsigned int unknown = static_cast<unsigned int>(-1);
+
+// GL 4.5 guarantees at least 16 vertex buffer bindings and 80 texture units, we only track the ones we use
+constexpr size_t tracked_bindings = 4;
+constexpr size_t tracked_units = 16;
+
+struct VertexBufferBinding {
+    unsigned int buffer = unknown;
+    size_t offset = 0;
+    size_t stride = 0;
+};
+
+struct VertexArrayState {
+    VertexBufferBinding bindings[tracked_bindings];
+    unsigned int element_buffer = unknown;
+};
+
+struct State {
+    unsigned int program = unknown;
+    unsigned int vao = unknown;
+    unsigned int units[tracked_units];
+    std::unordered_map<unsigned int, VertexArrayState> vertex_arrays;
+
+    GLStateCache::Counters counters;
+
+    State() {
+        for (auto& unit : units) { unit = unknown; }
+    }
+};
+
+State& get_state() {
+    static State state;
+    return state;
+}
+
+// Returns true if the state changed and has to be passed on to GL
+bool update(unsigned int& current, unsigned int value) {
+    auto& counters = get_state().counters;
+    if (current == value) {
+        ++counters.skipped;
+        return false;
+    }
+    current = value;
+    ++counters.issued;
+    return true;
+}
+
+}
+
+void GLStateCache::use_program(unsigned int program) {
+    if (update(get_state().program, program)) {
+        glUseProgram(program);
+    }
+}
+
+void GLStateCache::bind_vertex_array(unsigned int vao) {
+    if (update(get_state().vao, vao)) {
+        glBindVertexArray(vao);
+    }
+}
+
+void GLStateCache::bind_texture_unit(unsigned int unit, unsigned int texture) {
+    auto& state = get_state();
+    if (unit >= tracked_units) {
+        ++state.counters.issued;
+        glBindTextureUnit(unit, texture);
+        return;
+    }
+    if (update(state.units[unit], texture)) {
+        glBindTextureUnit(unit, texture);
+    }
+}
+
+void GLStateCache::vertex_buffer(unsigned int vao, unsigned int binding, unsigned int buffer, size_t offset, size_t stride) {
+    auto& state = get_state();
+    if (binding >= tracked_bindings) {
+        ++state.counters.issued;
+        glVertexArrayVertexBuffer(vao, binding, buffer, offset, stride);
+        return;
+    }
+    auto& current = state.vertex_arrays[vao].bindings[binding];
+    if (current.buffer == buffer && current.offset == offset && current.stride == stride) {
+        ++state.counters.skipped;
+        return;
+    }
+    current = VertexBufferBinding{buffer, offset, stride};
+    ++state.counters.issued;
+    glVertexArrayVertexBuffer(vao, binding, buffer, offset, stride);
+}
+
+void GLStateCache::element_buffer(unsigned int vao, unsigned int buffer) {
+    if (update(get_state().vertex_arrays[vao].element_buffer, buffer)) {
+        glVertexArrayElementBuffer(vao, buffer);
+    }
+}
+
+void GLStateCache::forget_texture(unsigned int texture) {
+    for (auto& unit : get_state().units) {
+        if (unit == texture) { unit = unknown; }
+    }
+}
+
+void GLStateCache::forget_buffer(unsigned int buffer) {
+    for (auto& [vao, vertex_array] : get_state().vertex_arrays) {
+        for (auto& binding : vertex_array.bindings) {
+            if (binding.buffer == buffer) { binding.buffer = unknown; }
+        }
+        if (vertex_array.element_buffer == buffer) { vertex_array.element_buffer = unknown; }
+    }
+}
+
+void GLStateCache::forget_vertex_array(unsigned int vao) {
+    auto& state = get_state();
+    state.vertex_arrays.erase(vao);
+    if (state.vao == vao) { state.vao = unknown; }
+}
+
+void GLStateCache::invalidate() {
+    auto& state = get_state();
+    Counters const counters = state.counters;
+    state = State();
+    state.counters = counters;
+}
+
+GLStateCache::Counters GLStateCache::counters() {
+    return get_state().counters;
+}
+
+}
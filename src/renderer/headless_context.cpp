@@ -0,0 +1,110 @@
+#include "renderer/headless_context.hpp"
+
+#include <glad/glad.h>
+
+#if TITAN_HEADLESS
+    #include <EGL/egl.h>
+    #include <EGL/eglext.h>
+#endif
+
+#include <stdexcept>
+
+namespace titan::renderer {
+
+#if TITAN_HEADLESS
+
+static EGLDisplay get_surfaceless_display() {
+    // Surfaceless platform first, it doesn't need a running display server
+    auto const get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (get_platform_display) {
+        EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display != EGL_NO_DISPLAY) { return display; }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+HeadlessContext create_headless_context(size_t width, size_t height) {
+    HeadlessContext result;
+    result.width = width;
+    result.height = height;
+
+    EGLDisplay display = get_surfaceless_display();
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+        throw std::runtime_error("Failed to initialize EGL display");
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        throw std::runtime_error("EGL display does not support desktop OpenGL");
+    }
+
+    // The default surface type is window, which surfaceless displays don't have
+    EGLint const config_attributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint config_count = 0;
+    if (!eglChooseConfig(display, config_attributes, &config, 1, &config_count) || config_count == 0) {
+        throw std::runtime_error("No EGL config with OpenGL support");
+    }
+
+    EGLint const context_attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+    if (context == EGL_NO_CONTEXT) {
+        throw std::runtime_error("Failed to create OpenGL 4.5 EGL context");
+    }
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        throw std::runtime_error("Failed to make EGL context current");
+    }
+    result.display = display;
+    result.context = context;
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        throw std::runtime_error("Failed to load glad");
+    }
+
+    // Surfaceless contexts have no default framebuffer
+    glCreateRenderbuffers(1, &result.color_buffer);
+    glNamedRenderbufferStorage(result.color_buffer, GL_RGBA8, width, height);
+    glCreateRenderbuffers(1, &result.depth_buffer);
+    glNamedRenderbufferStorage(result.depth_buffer, GL_DEPTH24_STENCIL8, width, height);
+    glCreateFramebuffers(1, &result.framebuffer);
+    glNamedFramebufferRenderbuffer(result.framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, result.color_buffer);
+    glNamedFramebufferRenderbuffer(result.framebuffer, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, result.depth_buffer);
+    if (glCheckNamedFramebufferStatus(result.framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        throw std::runtime_error("Offscreen framebuffer is incomplete");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, result.framebuffer);
+    glViewport(0, 0, width, height);
+
+    return result;
+}
+
+void destroy_headless_context(HeadlessContext& context) {
+    if (context.context == nullptr) { return; }
+    glDeleteFramebuffers(1, &context.framebuffer);
+    glDeleteRenderbuffers(1, &context.color_buffer);
+    glDeleteRenderbuffers(1, &context.depth_buffer);
+    EGLDisplay display = static_cast<EGLDisplay>(context.display);
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, static_cast<EGLContext>(context.context));
+    eglTerminate(display);
+    context = HeadlessContext{};
+}
+
+#else
+
+HeadlessContext create_headless_context(size_t, size_t) {
+    throw std::runtime_error("Titan was built without headless support, configure with -DTITAN_HEADLESS=ON");
+}
+
+void destroy_headless_context(HeadlessContext&) {}
+
+#endif
+
+}
@@ -0,0 +1,201 @@
+#include "renderer/instanced_terrain_renderer.hpp"
+#include "renderer/terrain_renderer.hpp"
+#include "renderer/gl_state.hpp"
+#include "renderer/util.hpp"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+namespace titan::renderer {
+
+static void create_vao(InstancedTerrainRenderInfo& info) {
+    info.vao = make_vertex_array();
+    unsigned int const vao = info.vao.get();
+
+    // Patch positions, relative to the chunk origin
+    glEnableVertexArrayAttrib(vao, 0);
+    glVertexArrayAttribFormat(vao, 0, 2, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribBinding(vao, 0, 0);
+
+    // Chunk offset
+    glEnableVertexArrayAttrib(vao, 3);
+    glVertexArrayAttribFormat(vao, 3, 2, GL_FLOAT, GL_FALSE, offsetof(InstancedTerrainRenderInfo::InstanceData, offset));
+    glVertexArrayAttribBinding(vao, 3, 1);
+
+    // Chunk LOD
+    glEnableVertexArrayAttrib(vao, 4);
+    glVertexArrayAttribFormat(vao, 4, 1, GL_FLOAT, GL_FALSE, offsetof(InstancedTerrainRenderInfo::InstanceData, lod));
+    glVertexArrayAttribBinding(vao, 4, 1);
+
+    // Binding 1 advances once per instance instead of once per vertex
+    glVertexArrayBindingDivisor(vao, 1, 1);
+}
+
+static void create_patch(InstancedTerrainRenderInfo::PatchMesh& patch, HeightmapTerrain const& terrain, size_t lod) {
+    // Every chunk has the same size, so the mesh of the first chunk tells us the resolution of this LOD
+    size_t const resolution = terrain.mesh.chunks[0].meshes[lod].resolution;
+
+    GridMeshOptions options;
+    options.tex_w = terrain.width;
+    options.tex_h = terrain.length;
+    GridMesh const mesh = create_grid_mesh(terrain.chunk_size, terrain.chunk_size, resolution, options);
+
+    // Texture coordinates and normals are calculated in the shader, so we only need to keep the positions
+    size_t const vertex_count = mesh.vertices.size() / mesh.vertex_size;
+    std::vector<float> positions(vertex_count * 2);
+    for (size_t i = 0; i < vertex_count; ++i) {
+        positions[2 * i] = mesh.vertices[i * mesh.vertex_size];
+        positions[2 * i + 1] = mesh.vertices[i * mesh.vertex_size + 1];
+    }
+
+    patch.vbo = make_buffer();
+    glNamedBufferStorage(patch.vbo.get(), positions.size() * sizeof(float), positions.data(), 0);
+    patch.ebo = make_buffer();
+    glNamedBufferStorage(patch.ebo.get(), mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(), 0);
+    patch.elements = mesh.indices.size();
+}
+
+static void update_instances(InstancedTerrainRenderInfo& info) {
+    size_t const lod_count = info.patches.size();
+    size_t const chunk_count = info.chunk_lods.size();
+
+    // Counting sort on the LOD index, so all instances with the same LOD are next to each other
+    std::fill(info.lod_instance_count.begin(), info.lod_instance_count.end(), 0);
+    for (size_t chunk_id = 0; chunk_id < chunk_count; ++chunk_id) {
+        if (!info.visible[chunk_id]) { continue; }
+        ++info.lod_instance_count[info.chunk_lods[chunk_id]];
+    }
+
+    size_t first = 0;
+    for (size_t lod = 0; lod < lod_count; ++lod) {
+        info.lod_first_instance[lod] = first;
+        first += info.lod_instance_count[lod];
+    }
+
+    std::vector<size_t> write_index = info.lod_first_instance;
+    for (size_t chunk_id = 0; chunk_id < chunk_count; ++chunk_id) {
+        if (!info.visible[chunk_id]) { continue; }
+        size_t const lod = info.chunk_lods[chunk_id];
+        auto& instance = info.instances[write_index[lod]++];
+        instance.offset[0] = info.chunk_offsets[2 * chunk_id];
+        instance.offset[1] = info.chunk_offsets[2 * chunk_id + 1];
+        instance.lod = lod;
+    }
+
+    // The instance buffer is tiny, so letting the driver handle synchronization is fine here.
+    // Only the visible instances are used, so there's no need to upload the rest
+    info.uploaded_bytes = first * sizeof(InstancedTerrainRenderInfo::InstanceData);
+    if (info.uploaded_bytes != 0) {
+        glNamedBufferSubData(info.instance_buffer.get(), 0, info.uploaded_bytes, info.instances.data());
+    }
+}
+
+InstancedTerrainRenderInfo make_instanced_terrain_render_info(HeightmapTerrain const& terrain, size_t const initial_lod,
+                                                              HeightmapFormat heightmap_format, VirtualHeightmapInfo const* virtual_heightmap) {
+    InstancedTerrainRenderInfo info;
+
+    create_vao(info);
+    if (virtual_heightmap) {
+        create_virtual_heightmap(info.virtual_height_map, terrain, *virtual_heightmap);
+    } else {
+        info.height_map = GLTexture(heightmap_texture_from_buffer(terrain.height_map.data(), terrain.heightmap_width, 
+                                                                  terrain.heightmap_height, heightmap_format));
+    }
+    info.height_map_base_level = heightmap_base_mip_level(terrain);
+    info.chunk_size = terrain.chunk_size;
+
+    size_t const lod_count = terrain.max_lod;
+    info.patches.resize(lod_count);
+    for (size_t lod = 0; lod < lod_count; ++lod) {
+        create_patch(info.patches[lod], terrain, lod);
+    }
+
+    size_t const chunk_count = terrain.mesh.chunks.size();
+    info.chunk_lods.resize(chunk_count, initial_lod);
+    resize_chunk_lod_state(info.lod_state, chunk_count);
+    info.chunk_offsets.resize(2 * chunk_count);
+    for (size_t i = 0; i < chunk_count; ++i) {
+        auto const& chunk_data = terrain.mesh.chunks[i];
+        info.chunk_offsets[2 * i] = chunk_data.xoffset;
+        info.chunk_offsets[2 * i + 1] = chunk_data.yoffset;
+        // Chunk center for distanced based LOD changing
+        float const center[3] = {chunk_data.xoffset + chunk_data.width / 2.0f, 
+                                 chunk_data.yoffset + chunk_data.length / 2.0f, 
+                                 chunk_data.height_at_center};
+        set_chunk_center(info.lod_state, i, center);
+    }
+
+    make_chunk_bounds(info.bounds, terrain);
+    make_occluder_boxes(info.occluder_boxes, terrain);
+    info.visible.resize(chunk_count, 1);
+    info.cull_stats.visible = chunk_count;
+
+    info.instances.resize(chunk_count);
+    info.lod_first_instance.resize(lod_count);
+    info.lod_instance_count.resize(lod_count);
+
+    info.instance_buffer = make_buffer();
+    glNamedBufferStorage(info.instance_buffer.get(), chunk_count * sizeof(InstancedTerrainRenderInfo::InstanceData),
+                         nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glVertexArrayVertexBuffer(info.vao.get(), 1, info.instance_buffer.get(), 0, sizeof(InstancedTerrainRenderInfo::InstanceData));
+
+    update_instances(info);
+
+    return info;
+}
+
+void update_lod_distance(InstancedTerrainRenderInfo& info, HeightmapTerrain const& terrain, glm::mat4 terrain_transform, float const* cam_pos) {
+    set_chunk_transform(info.lod_state, terrain_transform);
+    calculate_chunk_distances(info.lod_state, cam_pos);
+    calculate_distance_lods(info.lod_state, lod_near_distance, lod_far_distance, terrain.max_lod);
+    for (size_t chunk_id = 0; chunk_id < info.chunk_lods.size(); ++chunk_id) {
+        if (!info.visible[chunk_id]) { continue; }
+        // No buffers to swap here, the chunk simply moves to another instanced draw
+        info.chunk_lods[chunk_id] = info.lod_state.target_lod[chunk_id];
+    }
+
+    update_instances(info);
+}
+
+void cull_terrain(InstancedTerrainRenderInfo& info, glm::mat4 const& view_projection) {
+    info.cull_stats = cull_chunks(make_frustum(view_projection), info.bounds, info.visible);
+}
+
+void occlusion_cull_terrain(InstancedTerrainRenderInfo& info, glm::mat4 const& terrain_transform, float const* cam_pos) {
+    glm::vec4 const cam = glm::inverse(terrain_transform) * glm::vec4(cam_pos[0], cam_pos[1], cam_pos[2], 1);
+    float const cam_heightfield[3] = {cam.x, cam.y, -cam.z};
+    info.occlusion_stats = occlude_chunks(info.occluder, info.occluder_boxes, cam_heightfield, info.visible);
+}
+
+void update_height_map_pages(InstancedTerrainRenderInfo& info, HeightmapTerrain const& terrain, glm::mat4 const& terrain_transform, float const* cam_pos) {
+    if (!info.virtual_height_map.atlas) { return; }
+    glm::vec4 const cam = glm::inverse(terrain_transform) * glm::vec4(cam_pos[0], cam_pos[1], cam_pos[2], 1);
+    float const cam_terrain[2] = {cam.x, cam.y};
+    update_virtual_heightmap(info.virtual_height_map, terrain, cam_terrain);
+}
+
+DrawStats render_terrain(InstancedTerrainRenderInfo const& terrain) {
+    DrawStats stats;
+    // Bind noisemap
+    bind_height_map(terrain.height_map.get(), terrain.virtual_height_map);
+    glUniform1f(9, terrain.height_map_base_level);
+    glUniform1f(11, terrain.chunk_size);
+    GLStateCache::bind_vertex_array(terrain.vao.get());
+    // One draw for every LOD
+    for (size_t lod = 0; lod < terrain.patches.size(); ++lod) {
+        size_t const instance_count = terrain.lod_instance_count[lod];
+        if (instance_count == 0) { continue; }
+
+        auto const& patch = terrain.patches[lod];
+        GLStateCache::vertex_buffer(terrain.vao.get(), 0, patch.vbo.get(), 0, 2 * sizeof(float));
+        GLStateCache::element_buffer(terrain.vao.get(), patch.ebo.get());
+        glDrawElementsInstancedBaseInstance(GL_TRIANGLES, patch.elements, GL_UNSIGNED_INT, nullptr,
+                                            instance_count, terrain.lod_first_instance[lod]);
+        ++stats.draw_calls;
+        stats.triangles += instance_count * patch.elements / 3;
+    }
+    return stats;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include "renderer/lod_schedule.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace titan::renderer {
+
+void create_lod_schedule(LODSchedule& schedule, size_t chunk_count, float bucket_width, size_t bucket_count) {
+    schedule = LODSchedule{};
+    schedule.bucket_width = bucket_width;
+    schedule.buckets.resize(std::max<size_t>(bucket_count, 2));
+    schedule.chunk_bucket.resize(chunk_count, LODSchedule::not_scheduled);
+    schedule.is_due.resize(chunk_count, 0);
+    schedule.was_visible.resize(chunk_count, 0);
+    reset_lod_schedule(schedule);
+}
+
+void reset_lod_schedule(LODSchedule& schedule) {
+    for (auto& bucket : schedule.buckets) {
+        bucket.clear();
+    }
+    std::fill(schedule.chunk_bucket.begin(), schedule.chunk_bucket.end(), LODSchedule::not_scheduled);
+    schedule.pending.resize(schedule.chunk_bucket.size());
+    for (size_t i = 0; i < schedule.pending.size(); ++i) {
+        schedule.pending[i] = i;
+    }
+}
+
+void mark_chunk_due(LODSchedule& schedule, std::uint32_t chunk_id) {
+    if (schedule.is_due[chunk_id]) { return; }
+    schedule.is_due[chunk_id] = 1;
+    schedule.due.push_back(chunk_id);
+}
+
+void advance_lod_schedule(LODSchedule& schedule, float const* cam_pos) {
+    if (schedule.has_camera) {
+        float const dx = cam_pos[0] - schedule.last_cam[0];
+        float const dy = cam_pos[1] - schedule.last_cam[1];
+        float const dz = cam_pos[2] - schedule.last_cam[2];
+        schedule.odometer += std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+    std::copy(cam_pos, cam_pos + 3, schedule.last_cam);
+    schedule.has_camera = true;
+
+    for (std::uint32_t chunk_id : schedule.due) {
+        schedule.is_due[chunk_id] = 0;
+    }
+    schedule.due.clear();
+
+    for (std::uint32_t chunk_id : schedule.pending) {
+        mark_chunk_due(schedule, chunk_id);
+    }
+    schedule.pending.clear();
+
+    size_t const bucket_count = schedule.buckets.size();
+    size_t const current = (size_t)(schedule.odometer / schedule.bucket_width);
+    if (current <= schedule.drained_bucket) { return; }
+    // A big jump would visit the same ring slots more than once
+    size_t const drain_count = std::min(current - schedule.drained_bucket, bucket_count);
+    for (size_t i = 0; i < drain_count; ++i) {
+        size_t const slot = (current - i) % bucket_count;
+        for (std::uint32_t chunk_id : schedule.buckets[slot]) {
+            size_t const bucket = schedule.chunk_bucket[chunk_id];
+            // The chunk was rescheduled into another bucket after this entry was added
+            if (bucket == LODSchedule::not_scheduled || bucket % bucket_count != slot) { continue; }
+            schedule.chunk_bucket[chunk_id] = LODSchedule::not_scheduled;
+            mark_chunk_due(schedule, chunk_id);
+        }
+        schedule.buckets[slot].clear();
+    }
+    schedule.drained_bucket = current;
+}
+
+void schedule_chunk(LODSchedule& schedule, std::uint32_t chunk_id, float slack) {
+    size_t const bucket_count = schedule.buckets.size();
+    // Only buckets after the drained one up to a full ring ahead are free to use
+    double const horizon = (double)(bucket_count - 1) * schedule.bucket_width;
+    double const deadline = schedule.odometer + std::min((double)slack, horizon);
+    size_t const bucket = std::min((size_t)(deadline / schedule.bucket_width), schedule.drained_bucket + bucket_count - 1);
+    // The bucket was already drained, so it would never be looked at again
+    if (bucket <= schedule.drained_bucket) {
+        schedule.chunk_bucket[chunk_id] = LODSchedule::not_scheduled;
+        schedule.pending.push_back(chunk_id);
+        return;
+    }
+    schedule.chunk_bucket[chunk_id] = bucket;
+    schedule.buckets[bucket % bucket_count].push_back(chunk_id);
+}
+
+}
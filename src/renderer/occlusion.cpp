@@ -0,0 +1,128 @@
+#include "renderer/occlusion.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <queue>
+
+namespace titan::renderer {
+
+namespace {
+
+struct PendingOccluder {
+    float farthest;
+    float slope;
+    size_t first_bin;
+    size_t end_bin;
+};
+
+}
+
+// Smallest and largest distance between the camera and a point in the footprint
+static void footprint_distance_range(HeightfieldBox const& box, float const* cam, float& nearest, float& farthest) {
+    float const dx = std::max({box.min_x - cam[0], 0.0f, cam[0] - box.max_x});
+    float const dy = std::max({box.min_y - cam[1], 0.0f, cam[1] - box.max_y});
+    nearest = std::sqrt(dx * dx + dy * dy);
+    float const fx = std::max(std::abs(box.min_x - cam[0]), std::abs(box.max_x - cam[0]));
+    float const fy = std::max(std::abs(box.min_y - cam[1]), std::abs(box.max_y - cam[1]));
+    farthest = std::sqrt(fx * fx + fy * fy);
+}
+
+// Range of directions the footprint covers, in radians. Only valid when the camera is outside the footprint
+static void footprint_angle_range(HeightfieldBox const& box, float const* cam, float& min_angle, float& max_angle) {
+    constexpr float pi = std::numbers::pi_v<float>;
+    float const center = std::atan2((box.min_y + box.max_y) / 2.0f - cam[1], (box.min_x + box.max_x) / 2.0f - cam[0]);
+    float const corners[4][2] = {{box.min_x, box.min_y}, {box.max_x, box.min_y}, {box.min_x, box.max_y}, {box.max_x, box.max_y}};
+    float lo = 0;
+    float hi = 0;
+    // Measure corners relative to the center direction, so ranges crossing the -pi/pi seam stay in one piece
+    for (auto const& corner : corners) {
+        float offset = std::atan2(corner[1] - cam[1], corner[0] - cam[0]) - center;
+        if (offset > pi) { offset -= 2 * pi; }
+        if (offset < -pi) { offset += 2 * pi; }
+        lo = std::min(lo, offset);
+        hi = std::max(hi, offset);
+    }
+    // Shift to [0, 4pi) so bin indices are never negative
+    min_angle = center + lo + 2 * pi;
+    max_angle = center + hi + 2 * pi;
+}
+
+OcclusionStats occlude_chunks(HorizonOccluder& occluder, std::vector<HeightfieldBox> const& boxes, float const* cam, 
+                              std::vector<unsigned char>& visible) {
+    constexpr float pi = std::numbers::pi_v<float>;
+    OcclusionStats stats;
+    size_t const count = boxes.size();
+    size_t const resolution = occluder.resolution;
+    float const bin_width = 2 * pi / resolution;
+
+    occluder.horizon.assign(resolution, -std::numeric_limits<float>::infinity());
+    occluder.distances.resize(count);
+    occluder.order.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        float farthest;
+        footprint_distance_range(boxes[i], cam, occluder.distances[i], farthest);
+        occluder.order[i] = i;
+    }
+    std::sort(occluder.order.begin(), occluder.order.end(), [&occluder](std::uint32_t a, std::uint32_t b) {
+        return occluder.distances[a] < occluder.distances[b];
+    });
+
+    // Chunks only go into the horizon once they are completely closer to the camera than the chunk being tested,
+    // otherwise part of the tested chunk could be in front of them. Min-heap on the farthest distance.
+    auto const later = [](PendingOccluder const& a, PendingOccluder const& b) { return a.farthest > b.farthest; };
+    std::priority_queue<PendingOccluder, std::vector<PendingOccluder>, decltype(later)> pending(later);
+
+    for (std::uint32_t const chunk_id : occluder.order) {
+        HeightfieldBox const& box = boxes[chunk_id];
+        float nearest, farthest;
+        footprint_distance_range(box, cam, nearest, farthest);
+        // The camera is above this chunk, so it can't be hidden and doesn't hide anything in a single direction
+        if (nearest <= 0.0f) { continue; }
+
+        while (!pending.empty() && pending.top().farthest <= nearest) {
+            PendingOccluder const& occluding = pending.top();
+            for (size_t bin = occluding.first_bin; bin < occluding.end_bin; ++bin) {
+                float& horizon = occluder.horizon[bin % resolution];
+                horizon = std::max(horizon, occluding.slope);
+            }
+            pending.pop();
+        }
+
+        float min_angle, max_angle;
+        footprint_angle_range(box, cam, min_angle, max_angle);
+
+        if (visible[chunk_id]) {
+            ++stats.tested;
+            // Steepest slope any point of the chunk can have as seen from the camera
+            float const rise = box.max_height - cam[2];
+            float const max_slope = rise / (rise > 0 ? nearest : farthest);
+            size_t const last_bin = (size_t)(max_angle / bin_width);
+            bool hidden = true;
+            for (size_t bin = (size_t)(min_angle / bin_width); bin <= last_bin && hidden; ++bin) {
+                hidden = occluder.horizon[bin % resolution] >= max_slope;
+            }
+            if (hidden) {
+                visible[chunk_id] = 0;
+                ++stats.occluded;
+            }
+        }
+
+        // The surface is at least min_height everywhere in the chunk, and every ray in a bin that lies completely
+        // within the footprint's directions crosses it. So everything below this slope behind the chunk is hidden.
+        float const rise = box.min_height - cam[2];
+        PendingOccluder occluding;
+        occluding.farthest = farthest;
+        occluding.slope = rise / (rise > 0 ? farthest : nearest);
+        occluding.first_bin = (size_t)std::ceil(min_angle / bin_width);
+        occluding.end_bin = (size_t)std::floor(max_angle / bin_width);
+        if (occluding.first_bin < occluding.end_bin) {
+            pending.push(occluding);
+        }
+    }
+
+    return stats;
+}
+
+}
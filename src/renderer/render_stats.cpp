@@ -0,0 +1,131 @@
+#include "renderer/render_stats.hpp"
+#include "renderer/gl_state.hpp"
+#include "renderer/terrain_renderer.hpp"
+#include "renderer/instanced_terrain_renderer.hpp"
+#include "renderer/swap_buffer.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <ostream>
+
+namespace titan::renderer {
+
+// Frames between issuing a timer query and reading it back. Enough for the GPU to have finished in almost every case
+static constexpr size_t query_latency = 4;
+
+static std::uint64_t now_ns() {
+    auto const time = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+}
+
+void add_sample(RollingStat& stat, float value) {
+    if (stat.samples.empty()) { return; }
+    stat.samples[stat.next] = value;
+    stat.next = (stat.next + 1) % stat.samples.size();
+    stat.count = std::min(stat.count + 1, stat.samples.size());
+}
+
+float percentile(RollingStat const& stat, float p) {
+    if (stat.count == 0) { return 0; }
+    std::vector<float> sorted(stat.samples.begin(), stat.samples.begin() + stat.count);
+    size_t const index = std::min((size_t)(p * stat.count), stat.count - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
+
+void create_render_stats(RenderStats& stats, size_t window) {
+    stats.cpu_ms_history.samples.resize(window);
+    stats.gpu_ms_history.samples.resize(window);
+    stats.upload_stall_history.samples.resize(window);
+
+    stats.queries.resize(query_latency);
+    stats.query_pending.resize(query_latency, false);
+    glGenQueries(query_latency, stats.queries.data());
+}
+
+void destroy_render_stats(RenderStats& stats) {
+    glDeleteQueries(stats.queries.size(), stats.queries.data());
+    stats.queries.clear();
+    stats.query_pending.clear();
+}
+
+void begin_render_stats(RenderStats& stats) {
+    stats.frame_start_ns = now_ns();
+    stats.stall_start_ns = SwapBuffer::stall_nanoseconds();
+    auto const state_counters = GLStateCache::counters();
+    stats.state_changes_start = state_counters.issued;
+    stats.skipped_state_changes_start = state_counters.skipped;
+
+    size_t const slot = stats.frame % stats.queries.size();
+    unsigned int const query = stats.queries[slot];
+    if (stats.query_pending[slot]) {
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        // Reading the result now would stall, skip timing this frame instead
+        if (!available) { return; }
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+        stats.gpu_ms = elapsed / 1000000.0f;
+        add_sample(stats.gpu_ms_history, stats.gpu_ms);
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    stats.query_pending[slot] = true;
+    stats.query_active = true;
+}
+
+static void end_frame(RenderStats& stats, DrawStats const& draw, size_t uploaded_bytes) {
+    if (stats.query_active) {
+        glEndQuery(GL_TIME_ELAPSED);
+        stats.query_active = false;
+    }
+    ++stats.frame;
+
+    stats.cpu_ms = (now_ns() - stats.frame_start_ns) / 1000000.0f;
+    stats.upload_stall_ms = (SwapBuffer::stall_nanoseconds() - stats.stall_start_ns) / 1000000.0f;
+    auto const state_counters = GLStateCache::counters();
+    stats.state_changes = state_counters.issued - stats.state_changes_start;
+    stats.skipped_state_changes = state_counters.skipped - stats.skipped_state_changes_start;
+    stats.draw = draw;
+    stats.uploaded_bytes = uploaded_bytes;
+    add_sample(stats.cpu_ms_history, stats.cpu_ms);
+    add_sample(stats.upload_stall_history, stats.upload_stall_ms);
+}
+
+void end_render_stats(RenderStats& stats, TerrainRenderInfo const& info, DrawStats const& draw) {
+    end_frame(stats, draw, info.uploaded_bytes);
+
+    std::fill(stats.chunks_per_lod.begin(), stats.chunks_per_lod.end(), 0);
+    for (size_t chunk_id = 0; chunk_id < info.chunks.size(); ++chunk_id) {
+        size_t const lod = info.chunks[chunk_id].current_lod.lod;
+        if (!info.visible[chunk_id] || lod == TerrainRenderInfo::no_lod) { continue; }
+        if (lod >= stats.chunks_per_lod.size()) { stats.chunks_per_lod.resize(lod + 1, 0); }
+        ++stats.chunks_per_lod[lod];
+    }
+}
+
+void end_render_stats(RenderStats& stats, InstancedTerrainRenderInfo const& info, DrawStats const& draw) {
+    end_frame(stats, draw, info.uploaded_bytes);
+    stats.chunks_per_lod = info.lod_instance_count;
+}
+
+void print_render_stats(std::ostream& out, RenderStats const& stats) {
+    out << "CPU: " << stats.cpu_ms << " ms (p50 " << percentile(stats.cpu_ms_history, 0.5f)
+        << ", p99 " << percentile(stats.cpu_ms_history, 0.99f) << ")\n";
+    out << "GPU: " << stats.gpu_ms << " ms (p50 " << percentile(stats.gpu_ms_history, 0.5f)
+        << ", p99 " << percentile(stats.gpu_ms_history, 0.99f) << ")\n";
+    out << "Upload stalls: " << stats.upload_stall_ms << " ms (p50 " << percentile(stats.upload_stall_history, 0.5f)
+        << ", p99 " << percentile(stats.upload_stall_history, 0.99f) << ")\n";
+    out << "Draw calls: " << stats.draw.draw_calls << ", triangles: " << stats.draw.triangles
+        << ", uploaded: " << stats.uploaded_bytes / 1024 << " KiB\n";
+    out << "State changes: " << stats.state_changes << ", skipped as redundant: " << stats.skipped_state_changes << "\n";
+    out << "Chunks per LOD:";
+    for (size_t const count : stats.chunks_per_lod) {
+        out << " " << count;
+    }
+    out << "\n";
+}
+
+}
@@ -1,27 +1,23 @@
 #include "renderer/swap_buffer.hpp"
+#include "renderer/upload_pool.hpp"
+#include "trace.hpp"
 
 #include <glad/glad.h>
 
+#include <chrono>
 #include <iostream>
+#include <thread>
 
 namespace titan::renderer {
 
+static std::atomic<std::uint64_t> total_stall_ns = 0;
+
 SwapBuffer::SwapBuffer(SwapBuffer&& rhs) {
-    std::swap(size, rhs.size);
-    std::swap(handle, rhs.handle);
-    std::swap(worker, rhs.worker);
-    std::swap(target, rhs.target);
-    std::swap(mapped_data, rhs.mapped_data);
-    std::swap(cur_write_length, rhs.cur_write_length);
+    swap(rhs);
 }
 
 SwapBuffer& SwapBuffer::operator=(SwapBuffer&& rhs) {
-    std::swap(size, rhs.size);
-    std::swap(handle, rhs.handle);
-    std::swap(worker, rhs.worker);
-    std::swap(target, rhs.target);
-    std::swap(mapped_data, rhs.mapped_data);
-    std::swap(cur_write_length, rhs.cur_write_length);
+    swap(rhs);
     return *this;
 }
 
@@ -29,25 +25,44 @@ void SwapBuffer::create(unsigned int buffer_target, size_t max_byte_size) {
     target = buffer_target;
     size = max_byte_size;
 
-    glGenBuffers(1, &handle);
+    storage = make_buffer();
+    handle = storage.get();
     // Set buffer size by uploading null as data
     constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT;
-    glBindBuffer(target, handle);
-    glBufferStorage(target, max_byte_size, nullptr, flags);
+    glNamedBufferStorage(handle, max_byte_size, nullptr, flags);
     // Grab data pointer to persistent buffer storage
-    mapped_data = glMapBufferRange(target, 0, max_byte_size, flags | GL_MAP_FLUSH_EXPLICIT_BIT);
+    mapped_data = glMapNamedBufferRange(handle, 0, max_byte_size, flags | GL_MAP_FLUSH_EXPLICIT_BIT);
+}
+
+void SwapBuffer::create_view(unsigned int buffer_target, unsigned int buffer, size_t offset, size_t max_byte_size, void* mapped_ptr) {
+    target = buffer_target;
+    handle = buffer;
+    byte_offset = offset;
+    size = max_byte_size;
+    mapped_data = mapped_ptr;
 }
 
 SwapBuffer::~SwapBuffer() {
-//    glBindBuffer(target, handle);
-//    glUnmapBuffer(target);
-//    glDeleteBuffers(1, &handle);
+    // A worker may still be copying into the mapping, which has to stay valid until it's done
+    if (state == UploadState::Copying) {
+        while (!copy_done->load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+    if (fence) {
+        glDeleteSync(static_cast<GLsync>(fence));
+    }
+    // storage is deleted (and with that unmapped) by the DeletionQueue once the GPU is done with it
 }
 
 unsigned int SwapBuffer::get() const {
     return handle;
 }
 
+size_t SwapBuffer::offset() const {
+    return byte_offset;
+}
+
 size_t SwapBuffer::current_size() const {
     return cur_write_length;
 }
@@ -57,30 +72,77 @@ size_t SwapBuffer::max_size() const {
 }
 
 void SwapBuffer::start_data_upload(void const* data, size_t len) {
+    TITAN_TRACE_ZONE("SwapBuffer::start_data_upload");
+    // A previous upload into this buffer may still be in flight
+    if (state == UploadState::Copying) {
+        wait_for_upload();
+    }
+    if (fence) {
+        glDeleteSync(static_cast<GLsync>(fence));
+        fence = nullptr;
+    }
+
     cur_write_length = len;
-    worker = std::move(std::thread(
-        std::memcpy, mapped_data, data, len
-    ));
+    state = UploadState::Copying;
+    UploadPool::submit(mapped_data, data, len, copy_done.get());
+}
+
+bool SwapBuffer::poll_upload() {
+    if (state == UploadState::Copying) {
+        if (!copy_done->load(std::memory_order_acquire)) { return false; }
+        flush();
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        state = UploadState::Fenced;
+    }
+
+    if (state == UploadState::Fenced) {
+        // Timeout of 0 only checks the status of the fence
+        GLenum const status = glClientWaitSync(static_cast<GLsync>(fence), 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) { return false; }
+        glDeleteSync(static_cast<GLsync>(fence));
+        fence = nullptr;
+        state = UploadState::Idle;
+    }
+
+    return true;
 }
 
 void SwapBuffer::wait_for_upload() {
-    if (worker.joinable()) {
-        worker.join();
-        glBindBuffer(target, handle);
-        glFlushMappedBufferRange(target, 0, cur_write_length);
-    } else { 
-        return; 
+    if (state != UploadState::Copying) {
+        return;
+    }
+
+    TITAN_TRACE_ZONE("SwapBuffer::wait_for_upload");
+    auto const start = std::chrono::steady_clock::now();
+    while (!copy_done->load(std::memory_order_acquire)) {
+        std::this_thread::yield();
     }
+    auto const stall = std::chrono::steady_clock::now() - start;
+    total_stall_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(stall).count(), std::memory_order_relaxed);
+    // Commands issued after the flush see the new data, so there is no need to wait for a fence here
+    flush();
+    state = UploadState::Idle;
+}
+
+std::uint64_t SwapBuffer::stall_nanoseconds() {
+    return total_stall_ns.load(std::memory_order_relaxed);
+}
+
+void SwapBuffer::flush() {
+    glFlushMappedNamedBufferRange(handle, byte_offset, cur_write_length);
 }
 
 void SwapBuffer::swap(SwapBuffer& rhs) {
     std::swap(size, rhs.size);
     std::swap(handle, rhs.handle);
-    std::swap(worker, rhs.worker);
+    std::swap(storage, rhs.storage);
+    std::swap(byte_offset, rhs.byte_offset);
     std::swap(target, rhs.target);
     std::swap(mapped_data, rhs.mapped_data);
     std::swap(cur_write_length, rhs.cur_write_length);
-
+    std::swap(state, rhs.state);
+    std::swap(copy_done, rhs.copy_done);
+    std::swap(fence, rhs.fence);
 }
 
 }
\ No newline at end of file
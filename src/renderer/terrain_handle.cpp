@@ -0,0 +1,170 @@
+#include "renderer/terrain_handle.hpp"
+#include "trace.hpp"
+
+#include <utility>
+
+namespace titan::renderer {
+
+static void generate_terrain(TerrainHandle* handle) {
+    TITAN_TRACE_THREAD_NAME("Terrain rebuild thread");
+    TITAN_TRACE_ZONE("generate_terrain");
+    // An exception escaping a thread terminates the program, pass it on to the GL thread instead
+    try {
+        auto& terrain = handle->pending->terrain;
+        terrain = create_heightmap_terrain(handle->pending->info);
+        // Mips and format conversion are CPU work too, only the upload has to happen on the GL thread
+        if (handle->info.virtual_heightmap) {
+            handle->fallback_level_offset = build_virtual_heightmap_fallback(terrain, *handle->info.virtual_heightmap,
+                                                                             handle->texels);
+        } else {
+            build_heightmap_texels(terrain.height_map.data(), terrain.heightmap_width, terrain.heightmap_height,
+                                   handle->info.heightmap_format, handle->texels);
+        }
+    } catch (...) {
+        handle->error = std::current_exception();
+    }
+    handle->generated.store(true, std::memory_order_release);
+}
+
+static void start_rebuild(TerrainHandle& handle, HeightmapTerrainInfo const& terrain_info) {
+    handle.pending = std::make_unique<TerrainSlot>();
+    handle.pending->info = terrain_info;
+    handle.heightmap_cursor = HeightmapUploadCursor{};
+    handle.heightmap_uploaded = false;
+    handle.pool_reserved = false;
+    handle.next_chunk = 0;
+    handle.generated.store(false, std::memory_order_relaxed);
+    handle.stage = TerrainHandle::Stage::Generating;
+    handle.worker = std::thread(generate_terrain, &handle);
+}
+
+TerrainHandle::~TerrainHandle() {
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void create_terrain_handle(TerrainHandle& handle, HeightmapTerrainInfo const& terrain_info, TerrainHandleInfo const& info) {
+    handle.info = info;
+    handle.active = std::make_unique<TerrainSlot>();
+    auto& slot = *handle.active;
+    slot.info = terrain_info;
+    slot.terrain = create_heightmap_terrain(terrain_info);
+    slot.render_info = make_terrain_render_info(slot.terrain, slot.terrain.max_lod / 2, info.residency_budget,
+                                                info.heightmap_format, info.virtual_heightmap);
+}
+
+void destroy_terrain_handle(TerrainHandle& handle) {
+    if (handle.worker.joinable()) {
+        handle.worker.join();
+    }
+    handle.pending.reset();
+    handle.retired.reset();
+    handle.active.reset();
+    handle.texels = HeightmapTexels{};
+    handle.stage = TerrainHandle::Stage::Idle;
+    handle.has_queued_rebuild = false;
+    handle.error = nullptr;
+}
+
+void request_terrain_rebuild(TerrainHandle& handle, HeightmapTerrainInfo const& terrain_info) {
+    if (handle.stage != TerrainHandle::Stage::Idle) {
+        handle.queued_rebuild = terrain_info;
+        handle.has_queued_rebuild = true;
+        return;
+    }
+    start_rebuild(handle, terrain_info);
+}
+
+// Uploads the next part of pending. Returns true once everything is uploaded and fenced
+static bool upload_pending(TerrainHandle& handle) {
+    TITAN_TRACE_ZONE("upload_pending_terrain");
+    auto& slot = *handle.pending;
+    if (!handle.heightmap_uploaded) {
+        unsigned int const texture = handle.info.virtual_heightmap ? slot.render_info.virtual_height_map.fallback.get()
+                                                                   : slot.render_info.height_map.get();
+        handle.heightmap_uploaded = upload_heightmap_texels(texture, handle.texels, handle.heightmap_cursor,
+                                                            handle.info.upload_budget);
+        if (handle.heightmap_uploaded) {
+            handle.texels = HeightmapTexels{};
+        }
+        return false;
+    }
+
+    // Creating a slab allocates and clears a lot of memory, so they are created one per frame as well
+    if (!handle.pool_reserved) {
+        handle.pool_reserved = reserve_initial_lods(slot.render_info, slot.terrain);
+        return false;
+    }
+
+    size_t const chunk_count = slot.render_info.chunks.size();
+    if (handle.next_chunk < chunk_count) {
+        handle.next_chunk = upload_initial_lods(slot.render_info, slot.terrain, handle.next_chunk, handle.info.upload_budget);
+        return false;
+    }
+
+    // Copies are done by the upload workers, poll every chunk so they are all flushed and fenced as soon as possible
+    bool ready = true;
+    for (auto& chunk : slot.render_info.chunks) {
+        ready = poll_all_data_upload(chunk) && ready;
+    }
+    return ready;
+}
+
+bool update_terrain_handle(TerrainHandle& handle) {
+    if (handle.stage == TerrainHandle::Stage::Generating) {
+        if (!handle.generated.load(std::memory_order_acquire)) { return false; }
+        handle.worker.join();
+
+        if (handle.error) {
+            std::exception_ptr const error = std::exchange(handle.error, nullptr);
+            handle.pending.reset();
+            handle.texels = HeightmapTexels{};
+            handle.stage = TerrainHandle::Stage::Idle;
+            if (handle.has_queued_rebuild) {
+                handle.has_queued_rebuild = false;
+                start_rebuild(handle, handle.queued_rebuild);
+            }
+            std::rethrow_exception(error);
+        }
+
+        // Only the cheap parts of the setup happen in one go, the uploads are spread over the next frames
+        auto& slot = *handle.pending;
+        slot.render_info = make_terrain_render_info_deferred(slot.terrain, slot.terrain.max_lod / 2,
+                                                             handle.info.residency_budget);
+        if (handle.info.virtual_heightmap) {
+            create_virtual_heightmap_deferred(slot.render_info.virtual_height_map, slot.terrain,
+                                              *handle.info.virtual_heightmap, handle.texels,
+                                              handle.fallback_level_offset);
+        } else {
+            slot.render_info.height_map = GLTexture(create_heightmap_texture(handle.texels));
+        }
+        handle.stage = TerrainHandle::Stage::Uploading;
+        return false;
+    }
+
+    if (handle.stage != TerrainHandle::Stage::Uploading || !upload_pending(handle)) { return false; }
+
+    // Not freed yet, the caller may still be reading the old terrain on another thread
+    handle.retired = std::move(handle.active);
+    handle.active = std::move(handle.pending);
+    handle.stage = TerrainHandle::Stage::Idle;
+    ++handle.generation;
+
+    if (handle.has_queued_rebuild) {
+        handle.has_queued_rebuild = false;
+        start_rebuild(handle, handle.queued_rebuild);
+    }
+    return true;
+}
+
+void release_retired_terrain(TerrainHandle& handle) {
+    // The GL objects are queued for deletion, the frames in flight can still use them
+    handle.retired.reset();
+}
+
+bool terrain_rebuild_running(TerrainHandle const& handle) {
+    return handle.stage != TerrainHandle::Stage::Idle;
+}
+
+}
@@ -1,8 +1,14 @@
 #include "renderer/terrain_renderer.hpp"
+#include "renderer/gl_state.hpp"
 #include "renderer/util.hpp"
 
 #include <glad/glad.h>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+
 // debug
 #include <iostream>
 
@@ -10,48 +16,85 @@
 // meh
 #include <glm/glm.hpp> 
 
-using namespace std::chrono;
-
 namespace titan::renderer {
 
 static void create_vao(TerrainRenderInfo& info, HeightmapTerrain const& terrain) {
-    glGenVertexArrays(1, &info.vao);
-    glBindVertexArray(info.vao);
+    info.vao = make_vertex_array();
+    unsigned int const vao = info.vao.get();
+
+    // All attributes are interleaved in the same buffer, so they share binding 0 and a chunk only needs one bind
 
     // Positions
-    glEnableVertexAttribArray(0);
-    glVertexAttribFormat(0, 2, GL_FLOAT, GL_FALSE, 0);
-    glVertexAttribBinding(0, 0);
+    glEnableVertexArrayAttrib(vao, 0);
+    glVertexArrayAttribFormat(vao, 0, 2, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribBinding(vao, 0, 0);
 
     // TexCoords
-    glEnableVertexAttribArray(1);
-    glVertexAttribFormat(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float));
-    glVertexAttribBinding(1, 1);
+    glEnableVertexArrayAttrib(vao, 1);
+    glVertexArrayAttribFormat(vao, 1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float));
+    glVertexArrayAttribBinding(vao, 1, 0);
 
     // Normals
-    glEnableVertexAttribArray(2);
-    glVertexAttribFormat(2, 3, GL_FLOAT, GL_FALSE, 4 * sizeof(float));
-    glVertexAttribBinding(2, 2);
+    glEnableVertexArrayAttrib(vao, 2);
+    glVertexArrayAttribFormat(vao, 2, 3, GL_FLOAT, GL_FALSE, 4 * sizeof(float));
+    glVertexArrayAttribBinding(vao, 2, 0);
 }
 
-static void create_heightmap(TerrainRenderInfo& info, HeightmapTerrain const& terrain) {
-    info.height_map = texture_from_buffer(terrain.height_map.data(), terrain.heightmap_width, terrain.heightmap_height);
+
+float heightmap_base_mip_level(HeightmapTerrain const& terrain) {
+    float const texels_per_chunk = terrain.heightmap_width * terrain.chunk_size / terrain.width;
+    float const cells_per_chunk = terrain.mesh.chunks[0].meshes[0].resolution - 1;
+    return std::log2(texels_per_chunk / cells_per_chunk);
 }
 
-// Create swap buffers for max LOD specified in lod parameter
-static void make_swap_buffers_lod(HeightmapTerrain const& terrain, TerrainRenderInfo::LODBuffer& buffer, 
-                                  size_t chunk_id, size_t lod) {
-    HeightmapTerrain::Chunk const& chunk = terrain.mesh.chunks[chunk_id];
-    // Create VBO swap buffer
-    buffer.vbo.create(GL_ARRAY_BUFFER, chunk.meshes[lod].vertices.size() * sizeof(float));
-    // Create EBO swap buffer
-    buffer.ebo.create(GL_ELEMENT_ARRAY_BUFFER, chunk.meshes[lod].indices.size() * sizeof(unsigned int));
-    // Finalize
-    buffer.elements = chunk.meshes[lod].indices.size();
+// Bytes of vertex data in a block of the given LOD. Vertex data comes first, followed by the indices
+static size_t lod_vertex_bytes(HeightmapTerrain const& terrain, size_t lod) {
+    // Every chunk has the same size, so every chunk has the same amount of vertices for a given LOD
+    size_t const bytes = terrain.mesh.chunks[0].meshes[lod].vertices.size() * sizeof(float);
+    // Keep the indices aligned
+    return (bytes + 255) & ~size_t(255);
+}
+
+static size_t lod_index_bytes(HeightmapTerrain const& terrain, size_t lod) {
+    return terrain.mesh.chunks[0].meshes[lod].indices.size() * sizeof(unsigned int);
+}
+
+static void create_buffer_pool(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t residency_budget) {
+    // One size class for every LOD
+    std::vector<size_t> block_sizes(terrain.max_lod);
+    for (size_t lod = 0; lod < terrain.max_lod; ++lod) {
+        block_sizes[lod] = lod_vertex_bytes(terrain, lod) + lod_index_bytes(terrain, lod);
+    }
+    info.buffer_pool.create(block_sizes, residency_budget);
 }
 
-static void queue_swap_buffer_fill(HeightmapTerrain const& terrain, TerrainRenderInfo::LODBuffer& buffer,
+// Releases the pool block of a LOD buffer. The buffer holds no LOD afterwards
+static void release_lod_buffer(TerrainRenderInfo& info, TerrainRenderInfo::LODBuffer& buffer) {
+    info.buffer_pool.free(buffer.allocation);
+    buffer.lod = TerrainRenderInfo::no_lod;
+    buffer.elements = 0;
+    buffer.prefetched = false;
+}
+
+static void queue_swap_buffer_fill(TerrainRenderInfo& info, HeightmapTerrain const& terrain, TerrainRenderInfo::LODBuffer& buffer,
                                    size_t chunk_id, size_t lod) {
+    // Don't load LOD out of bounds
+    if (lod >= terrain.max_lod) {
+        release_lod_buffer(info, buffer);
+        return;
+    }
+
+    // Blocks of a size class only fit a single LOD, so switch to a block of the right size
+    if (buffer.allocation.size_class != lod) {
+        info.buffer_pool.free(buffer.allocation);
+        buffer.allocation = info.buffer_pool.allocate(lod);
+        auto const& allocation = buffer.allocation;
+        size_t const vertex_bytes = lod_vertex_bytes(terrain, lod);
+        buffer.vbo.create_view(GL_ARRAY_BUFFER, allocation.buffer, allocation.offset, vertex_bytes, allocation.mapped);
+        buffer.ebo.create_view(GL_ELEMENT_ARRAY_BUFFER, allocation.buffer, allocation.offset + vertex_bytes, 
+                               lod_index_bytes(terrain, lod), static_cast<unsigned char*>(allocation.mapped) + vertex_bytes);
+    }
+
     HeightmapTerrain::Chunk const& chunk = terrain.mesh.chunks[chunk_id];
     GridMesh const& mesh = chunk.meshes[lod];
     buffer.vbo.start_data_upload(mesh.vertices.data(), mesh.vertices.size() * sizeof(float));
@@ -60,117 +103,572 @@ static void queue_swap_buffer_fill(HeightmapTerrain const& terrain, TerrainRende
     buffer.lod = lod;
 }
 
-TerrainRenderInfo make_terrain_render_info(HeightmapTerrain const& terrain, size_t const initial_lod) {
+void make_chunk_bounds(ChunkBounds& bounds, HeightmapTerrain const& terrain) {
+    size_t const chunk_count = terrain.mesh.chunks.size();
+    resize_chunk_bounds(bounds, chunk_count);
+    for (size_t i = 0; i < chunk_count; ++i) {
+        auto const& chunk = terrain.mesh.chunks[i];
+        // The vertex shader displaces vertices to (1 - height) * height_scale
+        float const min[3] = {chunk.xoffset, chunk.yoffset, (1 - chunk.max_height) * terrain.height_scale};
+        float const max[3] = {chunk.xoffset + chunk.width, chunk.yoffset + chunk.length, (1 - chunk.min_height) * terrain.height_scale};
+        set_chunk_bounds(bounds, i, min, max);
+    }
+}
+
+void make_occluder_boxes(std::vector<HeightfieldBox>& boxes, HeightmapTerrain const& terrain) {
+    size_t const chunk_count = terrain.mesh.chunks.size();
+    boxes.resize(chunk_count);
+    for (size_t i = 0; i < chunk_count; ++i) {
+        auto const& chunk = terrain.mesh.chunks[i];
+        auto& box = boxes[i];
+        box.min_x = chunk.xoffset;
+        box.min_y = chunk.yoffset;
+        box.max_x = chunk.xoffset + chunk.width;
+        box.max_y = chunk.yoffset + chunk.length;
+        // Negated z of the displaced vertices
+        box.min_height = (chunk.min_height - 1) * terrain.height_scale;
+        box.max_height = (chunk.max_height - 1) * terrain.height_scale;
+    }
+}
+
+TerrainRenderInfo make_terrain_render_info(HeightmapTerrain const& terrain, size_t const initial_lod, size_t const residency_budget,
+                                           HeightmapFormat heightmap_format, VirtualHeightmapInfo const* virtual_heightmap) {
+    TerrainRenderInfo info = make_terrain_render_info_deferred(terrain, initial_lod, residency_budget);
+    if (virtual_heightmap) {
+        create_virtual_heightmap(info.virtual_height_map, terrain, *virtual_heightmap);
+    } else {
+        info.height_map = GLTexture(heightmap_texture_from_buffer(terrain.height_map.data(), terrain.heightmap_width, 
+                                                                  terrain.heightmap_height, heightmap_format));
+    }
+    upload_initial_lods(info, terrain, 0, std::numeric_limits<size_t>::max());
+    return info;
+}
+
+TerrainRenderInfo make_terrain_render_info_deferred(HeightmapTerrain const& terrain, size_t const initial_lod, 
+                                                    size_t const residency_budget) {
     TerrainRenderInfo info;
 
     create_vao(info, terrain);
-    create_heightmap(info, terrain);
+    info.height_map_base_level = heightmap_base_mip_level(terrain);
+    info.chunk_size = terrain.chunk_size;
+    create_buffer_pool(info, terrain, residency_budget);
 
-    // Fill chunk vbo's
     size_t const chunk_count = terrain.mesh.chunks.size();
-    size_t const lod_count = terrain.max_lod;
     info.chunks.resize(chunk_count);
+    resize_chunk_lod_state(info.lod_state, chunk_count);
     for (size_t i = 0; i < chunk_count; ++i) {
-        auto& chunk = info.chunks[i];
         auto const& chunk_data = terrain.mesh.chunks[i];
         // Chunk center for distanced based LOD changing
-        chunk.center[0] = chunk_data.xoffset + chunk_data.width / 2.0f;
-        chunk.center[1] = chunk_data.yoffset + chunk_data.length / 2.0f;
-        chunk.center[2] = chunk_data.height_at_center;
-        // Create swap buffers with highest LOD level, this is at index 0
-        make_swap_buffers_lod(terrain, chunk.higher_lod, i, 0);
-        make_swap_buffers_lod(terrain, chunk.current_lod, i, 0);
-        make_swap_buffers_lod(terrain, chunk.lower_lod, i, 0);
-        // Queue filling the swap buffers for this chunk
-        queue_swap_buffer_fill(terrain, chunk.higher_lod, i, initial_lod - 1);
-        queue_swap_buffer_fill(terrain, chunk.current_lod, i, initial_lod);
-        queue_swap_buffer_fill(terrain, chunk.lower_lod, i, initial_lod + 1);
+        float const center[3] = {chunk_data.xoffset + chunk_data.width / 2.0f, 
+                                 chunk_data.yoffset + chunk_data.length / 2.0f, 
+                                 chunk_data.height_at_center};
+        set_chunk_center(info.lod_state, i, center);
+        info.lod_state.current_lod[i] = initial_lod;
     }
 
+    // Buckets a fraction of a LOD band wide, so chunks are not re-evaluated long before they can change
+    float const lod_band_width = (lod_far_distance - lod_near_distance) / terrain.max_lod;
+    create_lod_schedule(info.lod_schedule, chunk_count, lod_band_width / 4.0f);
+
+    make_chunk_bounds(info.bounds, terrain);
+    make_occluder_boxes(info.occluder_boxes, terrain);
+    // Everything is visible until the first cull_terrain call
+    info.visible.resize(chunk_count, 1);
+    info.cull_stats.visible = chunk_count;
+
     // vertex layout stays constant, so we can pick any LOD on any chunk
     info.vertex_size = terrain.mesh.chunks[0].meshes[0].vertex_size;
 
     return info;
 }
 
+bool reserve_initial_lods(TerrainRenderInfo& info, HeightmapTerrain const& terrain) {
+    // Blocks needed for every LOD, the initial LOD of every chunk and its two neighbours
+    std::vector<size_t> blocks(terrain.max_lod);
+    for (size_t chunk_id = 0; chunk_id < info.chunks.size(); ++chunk_id) {
+        size_t const initial_lod = info.lod_state.current_lod[chunk_id];
+        for (size_t lod : {initial_lod - 1, initial_lod, initial_lod + 1}) {
+            if (lod < terrain.max_lod) { ++blocks[lod]; }
+        }
+    }
+
+    for (size_t lod = 0; lod < terrain.max_lod; ++lod) {
+        if (blocks[lod] != 0 && !info.buffer_pool.reserve(lod, blocks[lod])) { return false; }
+    }
+    return true;
+}
+
+size_t upload_initial_lods(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t first_chunk, size_t max_bytes) {
+    size_t const chunk_count = info.chunks.size();
+    size_t queued = 0;
+    size_t chunk_id = first_chunk;
+    // Always queue at least one chunk, so every call makes progress
+    for (; chunk_id < chunk_count && (chunk_id == first_chunk || queued < max_bytes); ++chunk_id) {
+        auto& chunk = info.chunks[chunk_id];
+        size_t const initial_lod = info.lod_state.current_lod[chunk_id];
+        // Queue filling the swap buffers for this chunk. Each one gets a block sized for its own LOD
+        queue_swap_buffer_fill(info, terrain, chunk.higher_lod, chunk_id, initial_lod - 1);
+        queue_swap_buffer_fill(info, terrain, chunk.current_lod, chunk_id, initial_lod);
+        queue_swap_buffer_fill(info, terrain, chunk.lower_lod, chunk_id, initial_lod + 1);
+
+        for (auto const* buffer : {&chunk.higher_lod, &chunk.current_lod, &chunk.lower_lod}) {
+            if (buffer->lod == TerrainRenderInfo::no_lod) { continue; }
+            queued += buffer->vbo.current_size() + buffer->ebo.current_size();
+        }
+    }
+    return chunk_id;
+}
+
 void swap_buffers(TerrainRenderInfo::LODBuffer& lhs, TerrainRenderInfo::LODBuffer& rhs) {
     lhs.vbo.swap(rhs.vbo);
     lhs.ebo.swap(rhs.ebo);
     std::swap(lhs.elements, rhs.elements);
     std::swap(lhs.lod, rhs.lod);
+    std::swap(lhs.allocation, rhs.allocation);
+    std::swap(lhs.prefetched, rhs.prefetched);
+}
+
+static bool lod_buffer_ready(TerrainRenderInfo::LODBuffer& buffer, size_t lod) {
+    if (buffer.lod != lod) { return false; }
+    // Poll both, so both get flushed as soon as possible
+    bool const vbo_ready = buffer.vbo.poll_upload();
+    bool const ebo_ready = buffer.ebo.poll_upload();
+    return vbo_ready && ebo_ready;
 }
 
-void higher_lod(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t chunk_id) {
-    // Make sure all data was uploaded before starting to swap buffers
+// Queues an upload of lod into the lower or higher LOD buffer of a chunk. The upload is started by process_upload_requests.
+// Returns true if a new request was made
+static bool request_lod_fill(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t chunk_id, bool lower, size_t lod, 
+                             bool prefetch = false) {
     auto& chunk = info.chunks[chunk_id];
-    await_all_data_upload(chunk);
+    auto& buffer = lower ? chunk.lower_lod : chunk.higher_lod;
+    if (lod >= terrain.max_lod) {
+        // No LOD to load, give the memory back
+        buffer.requested_lod = TerrainRenderInfo::no_lod;
+        release_lod_buffer(info, buffer);
+        return false;
+    }
+    if (buffer.lod == lod || buffer.requested_lod == lod) { return false; }
 
+    buffer.requested_lod = lod;
+    info.upload_requests.push_back(TerrainRenderInfo::UploadRequest{chunk_id, lower, lod, prefetch});
+    return true;
+}
+
+static void process_upload_requests(TerrainRenderInfo& info, HeightmapTerrain const& terrain) {
+    auto& requests = info.upload_requests;
+    std::sort(requests.begin(), requests.end(), [&info](auto const& a, auto const& b) {
+        return info.lod_state.distance[a.chunk_id] < info.lod_state.distance[b.chunk_id];
+    });
+
+    size_t bytes = 0;
+    size_t kept = 0;
+    for (auto const& request : requests) {
+        auto& chunk = info.chunks[request.chunk_id];
+        auto& buffer = request.lower ? chunk.lower_lod : chunk.higher_lod;
+        // Request was replaced by a newer one, or the chunk changed LOD in the meantime
+        if (buffer.requested_lod != request.lod) { continue; }
+
+        size_t const size = lod_vertex_bytes(terrain, request.lod) + lod_index_bytes(terrain, request.lod);
+        // Buffers that are still being written to have to wait, and so does everything over budget
+        bool const busy = !buffer.vbo.poll_upload() || !buffer.ebo.poll_upload();
+        if (busy || (bytes != 0 && bytes + size > info.upload_budget)) {
+            requests[kept++] = request;
+            continue;
+        }
+
+        queue_swap_buffer_fill(info, terrain, buffer, request.chunk_id, request.lod);
+        buffer.requested_lod = TerrainRenderInfo::no_lod;
+        buffer.prefetched = request.prefetch;
+        bytes += size;
+    }
+    requests.resize(kept);
+    info.uploaded_bytes = bytes;
+}
+
+bool higher_lod(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t chunk_id) {
+    auto& chunk = info.chunks[chunk_id];
     size_t const current_lod = chunk.current_lod.lod;
+    // The higher LOD buffer usually holds current_lod - 1, but it can hold any higher detail LOD after a jump
+    size_t const new_lod = chunk.higher_lod.lod;
+    if (current_lod == 0 || new_lod == TerrainRenderInfo::no_lod || new_lod >= current_lod) { return false; }
+    // Keep drawing the current LOD until the new one is resident and fenced
+    if (!poll_all_data_upload(chunk) || !lod_buffer_ready(chunk.higher_lod, new_lod)) { return false; }
+    if (chunk.higher_lod.prefetched) { ++info.prefetch_stats.hits; }
+    chunk.higher_lod.prefetched = false;
    
     // Previous LOD becomes current LOD
     swap_buffers(chunk.higher_lod, chunk.current_lod);
     // The old current LOD becomes the next LOD
     swap_buffers(chunk.higher_lod, chunk.lower_lod);
+    info.lod_state.current_lod[chunk_id] = chunk.current_lod.lod;
     // The old next LOD is now unused, fill it with the new previous LOD
     size_t new_previous_lod = chunk.current_lod.lod - 1;
-    // Don't load LOD out of bounds
-    if (chunk.current_lod.lod == 0) { return; }
-    queue_swap_buffer_fill(terrain, chunk.higher_lod, chunk_id, new_previous_lod);
+    request_lod_fill(info, terrain, chunk_id, false, new_previous_lod);
+    return true;
 }
 
-void lower_lod(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t chunk_id) {
-    // Make sure all data was uploaded before starting to swap buffers
+bool lower_lod(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t chunk_id) {
     auto& chunk = info.chunks[chunk_id];
-    await_all_data_upload(chunk);
-
     size_t const current_lod = chunk.current_lod.lod;
+    // The lower LOD buffer usually holds current_lod + 1, but it can hold any lower detail LOD after a jump
+    size_t const new_lod = chunk.lower_lod.lod;
+    if (new_lod == TerrainRenderInfo::no_lod || new_lod <= current_lod) { return false; }
+    // Keep drawing the current LOD until the new one is resident and fenced
+    if (!poll_all_data_upload(chunk) || !lod_buffer_ready(chunk.lower_lod, new_lod)) { return false; }
+    if (chunk.lower_lod.prefetched) { ++info.prefetch_stats.hits; }
+    chunk.lower_lod.prefetched = false;
 
     // Next LOD becomes current LOD
     swap_buffers(chunk.lower_lod, chunk.current_lod);
     // The old current LOD becomes the new previous LOD
     swap_buffers(chunk.lower_lod, chunk.higher_lod);
+    info.lod_state.current_lod[chunk_id] = chunk.current_lod.lod;
 
     // The old previous LOD is now unused, fill it with the new next LOD
     size_t const new_next_lod = chunk.current_lod.lod + 1;
-    // Don't load LOD out of bounds
-    if (chunk.current_lod.lod >= terrain.max_lod - 1) { return; }
-    queue_swap_buffer_fill(terrain, chunk.lower_lod, chunk_id, new_next_lod);
+    request_lod_fill(info, terrain, chunk_id, true, new_next_lod);
+    return true;
 }
 
-void update_lod_distance(TerrainRenderInfo& info, HeightmapTerrain const& terrain, glm::mat4 terrain_transform, float const* cam_pos) {
-    for (size_t chunk_id = 0; chunk_id < info.chunks.size(); ++chunk_id) {
-        auto const& center_raw = info.chunks[chunk_id].center;
-        glm::vec4 center = glm::vec4(center_raw[0], center_raw[1], center_raw[2], 1);
-        // Transform center with model matrix
-        center = terrain_transform * center;
-        update_lod_distance(info, terrain, chunk_id, &center.x, cam_pos);
+// Switches to target_lod once it is resident in the neighbour buffer in that direction. Until then it is
+// requested in place of the neighbour, and the chunk keeps drawing its current LOD.
+static void move_towards_lod(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t chunk_id, size_t target_lod) {
+    auto& chunk = info.chunks[chunk_id];
+    size_t const current_lod = chunk.current_lod.lod;
+    // A new request means the LOD was needed before anyone loaded it
+    if (target_lod > current_lod) {
+        if (chunk.lower_lod.lod != target_lod || !lower_lod(info, terrain, chunk_id)) {
+            if (request_lod_fill(info, terrain, chunk_id, true, target_lod)) { ++info.prefetch_stats.misses; }
+        }
+    } else if (target_lod < current_lod) {
+        if (chunk.higher_lod.lod != target_lod || !higher_lod(info, terrain, chunk_id)) {
+            if (request_lod_fill(info, terrain, chunk_id, false, target_lod)) { ++info.prefetch_stats.misses; }
+        }
     }
 }
 
-void update_lod_distance(TerrainRenderInfo& info, HeightmapTerrain const& terrain, 
-                         size_t chunk_id, float const* chunk_center, float const* cam_pos) {
-    auto const& chunk = info.chunks[chunk_id];
-    math::vec3 cam = {cam_pos[0], cam_pos[1], cam_pos[2]};
-    math::vec3 center = {chunk_center[0], chunk_center[1], chunk_center[2]};
-
-    float distance = math::magnitude(center - cam);  
+size_t lod_from_distance(HeightmapTerrain const& terrain, float distance) {
     // Very basic distance-based LOD
-    // Treshold for maximum LOD
-    constexpr float max_lod_distance = 5.0f;
-    // Treshold for minimum LOD
-    constexpr float min_lod_distance = 200.0f;
-    constexpr float distance_range = min_lod_distance - max_lod_distance;
-    distance -= max_lod_distance;
+    constexpr float distance_range = lod_far_distance - lod_near_distance;
+    distance -= lod_near_distance;
     float distance_pct = distance / distance_range;
     distance_pct = std::clamp(distance_pct, 0.0f, 1.0f);
     distance_pct *= terrain.max_lod;
-    if ((size_t)distance_pct > (chunk.current_lod.lod)) {
-        if (chunk.current_lod.lod >= terrain.max_lod - 1) { return; }
-        lower_lod(info, terrain, chunk_id);
-    } else if ((size_t)distance_pct < (chunk.current_lod.lod)) {
-        if (chunk.current_lod.lod ==  0) { return; }
-        higher_lod(info, terrain, chunk_id);
+    return std::min((size_t)distance_pct, terrain.max_lod - 1);
+}
+
+LODSelectionParams make_lod_selection_params(glm::mat4 const& projection, float viewport_height, float pixel_error, float hysteresis) {
+    LODSelectionParams params;
+    params.pixel_error = pixel_error;
+    params.hysteresis = hysteresis;
+    // projection[1][1] is cot(fov / 2), so an error of e at distance d covers e * projection[1][1] / d of half the screen
+    params.error_scale = projection[1][1] * viewport_height / 2.0f;
+    return params;
+}
+
+size_t lod_from_screen_space_error(HeightmapTerrain::Chunk const& chunk, float distance, size_t current_lod, LODSelectionParams const& params) {
+    // Don't divide by zero when the camera is right on top of the chunk
+    float const pixels_per_unit = params.error_scale / std::max(distance, 0.001f);
+    size_t const lod_count = chunk.lod_error.size();
+
+    // The lowest detail LOD that still looks good enough, errors only grow with the LOD index
+    auto lowest_detail_lod = [&](float threshold) {
+        size_t lod = 0;
+        while (lod + 1 < lod_count && chunk.lod_error[lod + 1] * pixels_per_unit <= threshold) {
+            ++lod;
+        }
+        return lod;
+    };
+
+    size_t const target = lowest_detail_lod(params.pixel_error);
+    // The current LOD has too much error on screen, refine right away
+    if (target < current_lod) { return target; }
+    // Only go to a lower detail LOD once it is well within the threshold, so chunks near the edge don't flip back and forth
+    size_t const coarser = lowest_detail_lod(params.pixel_error * (1.0f - params.hysteresis));
+    return std::max(coarser, current_lod);
+}
+
+// Frees the prefetched neighbour LODs of the farthest chunks until the pool is within its budget again.
+// The current LOD of a chunk is never evicted, since we need it for drawing.
+static void evict_far_chunks(TerrainRenderInfo& info) {
+    std::vector<size_t> order(info.chunks.size());
+    for (size_t i = 0; i < order.size(); ++i) { order[i] = i; }
+    std::sort(order.begin(), order.end(), [&info](size_t a, size_t b) { return info.lod_state.distance[a] > info.lod_state.distance[b]; });
+
+    for (size_t chunk_id : order) {
+        if (!info.buffer_pool.over_budget()) { return; }
+        auto& chunk = info.chunks[chunk_id];
+        for (auto* buffer : {&chunk.lower_lod, &chunk.higher_lod}) {
+            if (buffer->lod == TerrainRenderInfo::no_lod) { continue; }
+            // Can't free a block that a worker is still writing to
+            if (!buffer->vbo.poll_upload() || !buffer->ebo.poll_upload()) { continue; }
+            release_lod_buffer(info, *buffer);
+        }
+    }
+}
+
+// Step one LOD towards the target. If the neighbour isn't resident yet, for example because it was evicted to stay
+// within the memory budget or the upload is still queued, it is requested and we keep drawing the current LOD.
+static void step_towards_lod(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t chunk_id, size_t lod) {
+    size_t const current_lod = info.chunks[chunk_id].current_lod.lod;
+    if (lod > current_lod) {
+        move_towards_lod(info, terrain, chunk_id, current_lod + 1);
+    } else if (lod < current_lod) {
+        move_towards_lod(info, terrain, chunk_id, current_lod - 1);
+    }
+}
+
+// Stores the worldspace distance between each chunk center and the camera in lod_state.distance
+static void update_chunk_distances(TerrainRenderInfo& info, glm::mat4 const& terrain_transform, float const* cam_pos) {
+    // Centers are only transformed again when the terrain moves
+    set_chunk_transform(info.lod_state, terrain_transform);
+    calculate_chunk_distances(info.lod_state, cam_pos);
+    // LODs change behind the back of the distance LOD schedule here, so it has to start over if it's used again
+    reset_lod_schedule(info.lod_schedule);
+}
+
+// Shared tail of all LOD update modes
+static void finish_lod_update(TerrainRenderInfo& info, HeightmapTerrain const& terrain) {
+    process_upload_requests(info, terrain);
+
+    if (info.buffer_pool.over_budget()) {
+        evict_far_chunks(info);
+    }
+}
+
+// How far the camera can move before the distance based LOD of a chunk at this distance could change
+static float distance_lod_slack(HeightmapTerrain const& terrain, float distance) {
+    float const band_width = (lod_far_distance - lod_near_distance) / terrain.max_lod;
+    size_t const lod = lod_from_distance(terrain, distance);
+    float slack = std::numeric_limits<float>::max();
+    if (lod > 0) { 
+        slack = distance - (lod_near_distance + lod * band_width); 
     }
+    if (lod + 1 < terrain.max_lod) { 
+        slack = std::min(slack, lod_near_distance + (lod + 1) * band_width - distance); 
+    }
+    // Stay on the safe side of rounding errors near the band edges
+    return std::max(slack - 0.001f * band_width, 0.0f);
+}
+
+void update_lod_distance(TerrainRenderInfo& info, HeightmapTerrain const& terrain, glm::mat4 terrain_transform, float const* cam_pos) {
+    info.buffer_pool.collect();
+
+    auto& state = info.lod_state;
+    auto& schedule = info.lod_schedule;
+    // Every slack is relative to the old chunk positions
+    if (set_chunk_transform(state, terrain_transform)) {
+        reset_lod_schedule(schedule);
+    }
+    advance_lod_schedule(schedule, cam_pos);
+
+    // Culled chunks are dropped from the schedule, so pick them up again once they come into view
+    for (size_t chunk_id = 0; chunk_id < info.chunks.size(); ++chunk_id) {
+        if (info.visible[chunk_id] && !schedule.was_visible[chunk_id]) {
+            mark_chunk_due(schedule, chunk_id);
+        }
+        schedule.was_visible[chunk_id] = info.visible[chunk_id];
+    }
+
+    for (std::uint32_t const chunk_id : schedule.due) {
+        // Don't schedule LOD changes and uploads for chunks we can't see
+        if (!info.visible[chunk_id]) { continue; }
+
+        float const distance = calculate_chunk_distance(state, chunk_id, cam_pos);
+        state.distance[chunk_id] = distance;
+        size_t const lod = lod_from_distance(terrain, distance);
+        state.target_lod[chunk_id] = lod;
+        step_towards_lod(info, terrain, chunk_id, lod);
+
+        // Keep looking at chunks every frame until they reach their target LOD
+        if (info.chunks[chunk_id].current_lod.lod != lod) {
+            schedule_chunk(schedule, chunk_id, 0.0f);
+        } else {
+            schedule_chunk(schedule, chunk_id, distance_lod_slack(terrain, distance));
+        }
+    }
+
+    finish_lod_update(info, terrain);
+}
+
+void update_lod_distance(TerrainRenderInfo& info, HeightmapTerrain const& terrain, size_t chunk_id, float distance) {
+    info.lod_state.distance[chunk_id] = distance;
+    step_towards_lod(info, terrain, chunk_id, lod_from_distance(terrain, distance));
+}
+
+void update_lod_screen_space_error(TerrainRenderInfo& info, HeightmapTerrain const& terrain, glm::mat4 terrain_transform, 
+                                   float const* cam_pos, LODSelectionParams const& params) {
+    info.buffer_pool.collect();
+    update_chunk_distances(info, terrain_transform, cam_pos);
+
+    for (size_t chunk_id = 0; chunk_id < info.chunks.size(); ++chunk_id) {
+        if (!info.visible[chunk_id]) { continue; }
+        // Unlike distance based LOD, this can jump several LODs at once
+        size_t const target = lod_from_screen_space_error(terrain.mesh.chunks[chunk_id], info.lod_state.distance[chunk_id], 
+                                                          info.chunks[chunk_id].current_lod.lod, params);
+        info.lod_state.target_lod[chunk_id] = target;
+        move_towards_lod(info, terrain, chunk_id, target);
+    }
+
+    finish_lod_update(info, terrain);
+}
+
+size_t allocate_triangle_budget(TerrainRenderInfo const& info, HeightmapTerrain const& terrain, size_t triangle_budget, 
+                                LODSelectionParams const& params, std::vector<size_t>& target_lods) {
+    return allocate_triangle_budget(terrain, info.visible, info.lod_state.distance, triangle_budget, params, target_lods);
+}
+
+size_t allocate_triangle_budget(HeightmapTerrain const& terrain, std::vector<unsigned char> const& visible, 
+                                std::vector<float> const& distances, size_t triangle_budget, LODSelectionParams const& params, 
+                                std::vector<size_t>& target_lods) {
+    size_t const chunk_count = terrain.mesh.chunks.size();
+    size_t const lod_count = terrain.max_lod;
+    // Every chunk has the same grid for a given LOD
+    std::vector<size_t> lod_triangles(lod_count);
+    for (size_t lod = 0; lod < lod_count; ++lod) {
+        lod_triangles[lod] = terrain.mesh.chunks[0].meshes[lod].indices.size() / 3;
+    }
+
+    struct Refinement {
+        // Reduction in screen space error per added triangle
+        float priority;
+        size_t chunk_id;
+        size_t lod;
+    };
+    auto const compare = [](Refinement const& a, Refinement const& b) { return a.priority < b.priority; };
+    std::priority_queue<Refinement, std::vector<Refinement>, decltype(compare)> queue(compare);
+
+    // Pushes the next useful refinement for a chunk that currently sits at the given LOD
+    auto const push_refinement = [&](size_t chunk_id, size_t lod) {
+        auto const& errors = terrain.mesh.chunks[chunk_id].lod_error;
+        float const pixels_per_unit = params.error_scale / std::max(distances[chunk_id], 0.001f);
+        float const error = errors[lod] * pixels_per_unit;
+        // Already looks good enough, more triangles won't be visible
+        if (error <= params.pixel_error) { return; }
+        // Skip over LODs that don't reduce the error at all, they would only cost triangles
+        size_t finer = lod;
+        while (finer > 0 && errors[finer - 1] >= errors[lod]) { --finer; }
+        if (finer == 0 && errors[0] >= errors[lod]) { return; }
+        --finer;
+        float const reduction = error - errors[finer] * pixels_per_unit;
+        size_t const cost = lod_triangles[finer] - lod_triangles[lod];
+        queue.push(Refinement{reduction / std::max<size_t>(cost, 1), chunk_id, finer});
+    };
+
+    // Start every visible chunk at the lowest detail LOD
+    size_t used = 0;
+    target_lods.assign(chunk_count, TerrainRenderInfo::no_lod);
+    for (size_t chunk_id = 0; chunk_id < chunk_count; ++chunk_id) {
+        if (!visible[chunk_id]) { continue; }
+        target_lods[chunk_id] = lod_count - 1;
+        used += lod_triangles[lod_count - 1];
+        push_refinement(chunk_id, lod_count - 1);
+    }
+
+    // Hand out refinements with the best error reduction per triangle first. A refinement that doesn't fit is dropped,
+    // but cheaper ones for other chunks may still fit in what's left of the budget
+    while (!queue.empty()) {
+        Refinement const refinement = queue.top();
+        queue.pop();
+        size_t const cost = lod_triangles[refinement.lod] - lod_triangles[target_lods[refinement.chunk_id]];
+        if (used + cost > triangle_budget) { continue; }
+        used += cost;
+        target_lods[refinement.chunk_id] = refinement.lod;
+        push_refinement(refinement.chunk_id, refinement.lod);
+    }
+    return used;
+}
+
+void update_lod_triangle_budget(TerrainRenderInfo& info, HeightmapTerrain const& terrain, glm::mat4 terrain_transform, 
+                                float const* cam_pos, size_t triangle_budget, LODSelectionParams const& params) {
+    info.buffer_pool.collect();
+    update_chunk_distances(info, terrain_transform, cam_pos);
+
+    info.budget_triangles = allocate_triangle_budget(info, terrain, triangle_budget, params, info.target_lods);
+    for (size_t chunk_id = 0; chunk_id < info.chunks.size(); ++chunk_id) {
+        if (info.target_lods[chunk_id] == TerrainRenderInfo::no_lod) { continue; }
+        info.lod_state.target_lod[chunk_id] = info.target_lods[chunk_id];
+        move_towards_lod(info, terrain, chunk_id, info.target_lods[chunk_id]);
+    }
+
+    finish_lod_update(info, terrain);
+}
+
+void prefetch_lods(TerrainRenderInfo& info, HeightmapTerrain const& terrain, float const* predicted_pos, LODSelectionParams const& params) {
+    auto const& state = info.lod_state;
+    for (size_t chunk_id = 0; chunk_id < info.chunks.size(); ++chunk_id) {
+        if (!info.visible[chunk_id]) { continue; }
+        auto const& chunk = info.chunks[chunk_id];
+        size_t const current_lod = chunk.current_lod.lod;
+        // Chunks on their way to another LOD already use both neighbour buffers
+        if (state.target_lod[chunk_id] != current_lod || chunk.higher_lod.requested_lod != TerrainRenderInfo::no_lod
+            || chunk.lower_lod.requested_lod != TerrainRenderInfo::no_lod) { 
+            continue; 
+        }
+
+        float const distance = calculate_chunk_distance(state, chunk_id, predicted_pos);
+        size_t const lod = lod_from_screen_space_error(terrain.mesh.chunks[chunk_id], distance, current_lod, params);
+        if (lod == current_lod) { continue; }
+        if (request_lod_fill(info, terrain, chunk_id, lod > current_lod, lod, true)) {
+            ++info.prefetch_stats.issued;
+        }
+    }
+}
+
+void apply_lod_targets(TerrainRenderInfo& info, HeightmapTerrain const& terrain, std::vector<float> const& distances,
+                       std::vector<size_t> const& target_lods, std::vector<size_t> const& prefetch_lods) {
+    info.buffer_pool.collect();
+    std::copy(distances.begin(), distances.end(), info.lod_state.distance.begin());
+    // LODs change behind the back of the distance LOD schedule here, so it has to start over if it's used again
+    reset_lod_schedule(info.lod_schedule);
+
+    for (size_t chunk_id = 0; chunk_id < info.chunks.size(); ++chunk_id) {
+        if (target_lods[chunk_id] == TerrainRenderInfo::no_lod) { continue; }
+        info.lod_state.target_lod[chunk_id] = target_lods[chunk_id];
+        move_towards_lod(info, terrain, chunk_id, target_lods[chunk_id]);
+    }
+
+    // Same rules as prefetch_lods. The prefetch LOD was picked with the LOD the chunk had when the frame was prepared
+    for (size_t chunk_id = 0; chunk_id < prefetch_lods.size(); ++chunk_id) {
+        size_t const lod = prefetch_lods[chunk_id];
+        if (lod == TerrainRenderInfo::no_lod || target_lods[chunk_id] == TerrainRenderInfo::no_lod) { continue; }
+        auto const& chunk = info.chunks[chunk_id];
+        size_t const current_lod = chunk.current_lod.lod;
+        if (lod == current_lod || target_lods[chunk_id] != current_lod || chunk.higher_lod.requested_lod != TerrainRenderInfo::no_lod
+            || chunk.lower_lod.requested_lod != TerrainRenderInfo::no_lod) {
+            continue;
+        }
+        if (request_lod_fill(info, terrain, chunk_id, lod > current_lod, lod, true)) {
+            ++info.prefetch_stats.issued;
+        }
+    }
+
+    finish_lod_update(info, terrain);
+}
+
+float prefetch_hit_rate(TerrainRenderInfo::PrefetchStats const& stats) {
+    size_t const total = stats.hits + stats.misses;
+    if (total == 0) { return 0.0f; }
+    return (float)stats.hits / (float)total;
+}
+
+void cull_terrain(TerrainRenderInfo& info, glm::mat4 const& view_projection) {
+    info.cull_stats = cull_chunks(make_frustum(view_projection), info.bounds, info.visible);
+}
+
+void occlusion_cull_terrain(TerrainRenderInfo& info, glm::mat4 const& terrain_transform, float const* cam_pos) {
+    // Occluder boxes are in terrain space
+    glm::vec4 const cam = glm::inverse(terrain_transform) * glm::vec4(cam_pos[0], cam_pos[1], cam_pos[2], 1);
+    float const cam_heightfield[3] = {cam.x, cam.y, -cam.z};
+    info.occlusion_stats = occlude_chunks(info.occluder, info.occluder_boxes, cam_heightfield, info.visible);
+}
+
+void update_height_map_pages(TerrainRenderInfo& info, HeightmapTerrain const& terrain, glm::mat4 const& terrain_transform, float const* cam_pos) {
+    if (!info.virtual_height_map.atlas) { return; }
+    glm::vec4 const cam = glm::inverse(terrain_transform) * glm::vec4(cam_pos[0], cam_pos[1], cam_pos[2], 1);
+    float const cam_terrain[2] = {cam.x, cam.y};
+    update_virtual_heightmap(info.virtual_height_map, terrain, cam_terrain);
 }
 
 void await_all_data_upload(TerrainRenderInfo::ChunkRenderInfo& chunk) {
@@ -184,26 +682,59 @@ void await_all_data_upload(TerrainRenderInfo::ChunkRenderInfo& chunk) {
     chunk.lower_lod.ebo.wait_for_upload();
 }
 
-void render_terrain(TerrainRenderInfo const& terrain) {
+bool poll_all_data_upload(TerrainRenderInfo::ChunkRenderInfo& chunk) {
+    // Poll all buffers, so every finished copy gets flushed this frame
+    bool ready = chunk.current_lod.vbo.poll_upload();
+    ready = chunk.current_lod.ebo.poll_upload() && ready;
+
+    ready = chunk.higher_lod.vbo.poll_upload() && ready;
+    ready = chunk.higher_lod.ebo.poll_upload() && ready;
+
+    ready = chunk.lower_lod.vbo.poll_upload() && ready;
+    ready = chunk.lower_lod.ebo.poll_upload() && ready;
+    return ready;
+}
+
+static void bind_terrain(TerrainRenderInfo const& terrain) {
     // Bind noisemap
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, terrain.height_map);
-    glBindVertexArray(terrain.vao);
+    bind_height_map(terrain.height_map.get(), terrain.virtual_height_map);
+    glUniform1f(9, terrain.height_map_base_level);
+    glUniform1f(11, terrain.chunk_size);
+    GLStateCache::bind_vertex_array(terrain.vao.get());
+}
+
+static void draw_chunk(TerrainRenderInfo const& terrain, size_t chunk_id, DrawStats& stats) {
+    auto const& chunk = terrain.chunks[chunk_id];
+    auto const& buf = chunk.current_lod;
+
+    // Both buffers are blocks in a pool slab, so they start at an offset. Chunks in the same slab share the element buffer
+    GLStateCache::vertex_buffer(terrain.vao.get(), 0, buf.vbo.get(), buf.vbo.offset(), terrain.vertex_size * sizeof(float));
+    GLStateCache::element_buffer(terrain.vao.get(), buf.ebo.get());
+    glUniform1f(10, buf.lod);
+    glDrawElements(GL_TRIANGLES, buf.elements, GL_UNSIGNED_INT, reinterpret_cast<void const*>(buf.ebo.offset()));
+    ++stats.draw_calls;
+    stats.triangles += buf.elements / 3;
+}
+
+DrawStats render_terrain(TerrainRenderInfo const& terrain) {
+    DrawStats stats;
+    bind_terrain(terrain);
     // Render all chunks
     size_t const chunk_count = terrain.chunks.size();
     for (size_t i = 0; i < chunk_count; ++i) {
-        auto const& chunk = terrain.chunks[i];
-        auto const& buf = chunk.current_lod;
+        if (!terrain.visible[i]) { continue; }
+        draw_chunk(terrain, i, stats);
+    }
+    return stats;
+}
 
-        unsigned int vbo = buf.vbo.get();
-        unsigned int ebo = buf.ebo.get();
-        // Update buffers for VAO
-        glBindVertexBuffer(0, vbo, 0, terrain.vertex_size * sizeof(float));
-        glBindVertexBuffer(1, vbo, 0, terrain.vertex_size * sizeof(float));
-        glBindVertexBuffer(2, vbo, 0, terrain.vertex_size * sizeof(float));
-        glVertexArrayElementBuffer(terrain.vao, ebo);
-        glDrawElements(GL_TRIANGLES, buf.elements, GL_UNSIGNED_INT, nullptr);
+DrawStats render_terrain(TerrainRenderInfo const& terrain, std::vector<std::uint32_t> const& draw_list) {
+    DrawStats stats;
+    bind_terrain(terrain);
+    for (std::uint32_t const chunk_id : draw_list) {
+        draw_chunk(terrain, chunk_id, stats);
     }
+    return stats;
 }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,197 @@
+#include "renderer/upload_pool.hpp"
+#include "trace.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define TITAN_UPLOAD_SSE 1
+    #include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <semaphore>
+#include <thread>
+#include <vector>
+
+namespace titan::renderer {
+
+namespace {
+
+struct UploadJob {
+    void* dst;
+    void const* src;
+    size_t len;
+    std::atomic<bool>* done;
+};
+
+// Bounded multi-producer multi-consumer queue (Dmitry Vyukov's design). Each cell has a sequence number that
+// tells producers and consumers whether the cell is free to write to or ready to read.
+class JobQueue {
+public:
+    static constexpr size_t capacity = 4096;
+
+    bool push(UploadJob const& job) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & (capacity - 1)];
+            size_t const seq = cell.sequence.load(std::memory_order_acquire);
+            std::intptr_t const diff = (std::intptr_t)seq - (std::intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.job = job;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // Full
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(UploadJob& job) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & (capacity - 1)];
+            size_t const seq = cell.sequence.load(std::memory_order_acquire);
+            std::intptr_t const diff = (std::intptr_t)seq - (std::intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    job = cell.job;
+                    cell.sequence.store(pos + capacity, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // Empty
+                return false;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    JobQueue() {
+        for (size_t i = 0; i < capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        UploadJob job;
+    };
+
+    Cell cells[capacity];
+    // Keep producer and consumer positions on separate cache lines
+    alignas(64) std::atomic<size_t> enqueue_pos = 0;
+    alignas(64) std::atomic<size_t> dequeue_pos = 0;
+};
+
+class Workers {
+public:
+    Workers() {
+        // Leave one core for the render thread
+        unsigned int const cores = std::thread::hardware_concurrency();
+        size_t const count = cores > 1 ? cores - 1 : 1;
+        threads.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            threads.emplace_back(&Workers::work, this);
+        }
+    }
+
+    ~Workers() {
+        stop.store(true);
+        work_available.release(threads.size());
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void submit(UploadJob const& job) {
+        if (!queue.push(job)) {
+            // Queue is full, do the copy ourselves instead of waiting for a free slot
+            UploadPool::stream_copy(job.dst, job.src, job.len);
+            job.done->store(true, std::memory_order_release);
+            return;
+        }
+        work_available.release();
+    }
+
+    size_t count() const {
+        return threads.size();
+    }
+
+private:
+    void work() {
+        TITAN_TRACE_THREAD_NAME("Upload worker");
+        while (true) {
+            work_available.acquire();
+            UploadJob job;
+            if (queue.pop(job)) {
+                TITAN_TRACE_ZONE("upload copy");
+                UploadPool::stream_copy(job.dst, job.src, job.len);
+                job.done->store(true, std::memory_order_release);
+            } else if (stop.load()) {
+                return;
+            }
+        }
+    }
+
+    JobQueue queue;
+    std::counting_semaphore<> work_available{0};
+    std::atomic<bool> stop = false;
+    std::vector<std::thread> threads;
+};
+
+Workers& get_workers() {
+    // Started on first use, joined when the program exits
+    static Workers workers;
+    return workers;
+}
+
+}
+
+void UploadPool::submit(void* dst, void const* src, size_t len, std::atomic<bool>* done) {
+    done->store(false, std::memory_order_relaxed);
+    get_workers().submit(UploadJob{dst, src, len, done});
+}
+
+void UploadPool::stream_copy(void* dst, void const* src, size_t len) {
+#if TITAN_UPLOAD_SSE
+    auto* out = static_cast<unsigned char*>(dst);
+    auto const* in = static_cast<unsigned char const*>(src);
+    // Copy the unaligned head normally, non-temporal stores need a 16 byte aligned destination
+    size_t const head = std::min(len, (16 - ((std::uintptr_t)out & 15)) & 15);
+    std::memcpy(out, in, head);
+    out += head;
+    in += head;
+    len -= head;
+
+    // Write full cache lines at a time, so the write-combining buffers can flush them in one go
+    for (; len >= 64; len -= 64, in += 64, out += 64) {
+        __m128i const a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in));
+        __m128i const b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + 16));
+        __m128i const c = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + 32));
+        __m128i const d = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(out), a);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(out + 16), b);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(out + 32), c);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(out + 48), d);
+    }
+    std::memcpy(out, in, len);
+    // Make the streaming stores visible before anyone sees the copy as done
+    _mm_sfence();
+#else
+    std::memcpy(dst, src, len);
+#endif
+}
+
+size_t UploadPool::worker_count() {
+    return get_workers().count();
+}
+
+}
\ No newline at end of file
@@ -3,10 +3,16 @@
 #include <glad/glad.h>
 #include <stb/stb_image.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
 #include <fstream>
+#include <limits>
 #include <string>
 #include <stdexcept>
 #include <iostream>
+#include <thread>
 
 namespace titan::renderer {
 
@@ -36,6 +42,112 @@ static unsigned int create_shader_stage(GLenum stage, const char* source) {
     return shader;
 }
 
+static std::string shader_cache_directory = "shader_cache";
+
+void set_shader_cache_directory(std::string const& path) {
+    shader_cache_directory = path;
+}
+
+std::uint64_t hash_string(std::string const& str, std::uint64_t hash) {
+    for (unsigned char const c : str) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    // Separator, so moving text from one string to the next changes the hash
+    hash ^= 0xff;
+    hash *= 1099511628211ull;
+    return hash;
+}
+
+bool write_file_atomic(std::filesystem::path const& path, std::initializer_list<FileChunk> chunks) {
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+    std::filesystem::path temp_path = path;
+    temp_path += ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary);
+        if (!file) { return false; }
+        for (FileChunk const& chunk : chunks) {
+            file.write(static_cast<char const*>(chunk.data), chunk.size);
+        }
+        if (!file) { return false; }
+    }
+    std::filesystem::rename(temp_path, path, error);
+    return !error;
+}
+
+static std::string gl_string(GLenum name) {
+    char const* str = reinterpret_cast<char const*>(glGetString(name));
+    return str ? str : "";
+}
+
+// Binaries are only valid for the exact driver that created them, so the driver is part of the key
+static std::filesystem::path shader_cache_path(std::string const& vertex, std::string const& fragment, std::string const& geometry) {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (auto const& str : {vertex, fragment, geometry, gl_string(GL_VENDOR), gl_string(GL_RENDERER), gl_string(GL_VERSION)}) {
+        hash = hash_string(str, hash);
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+    return std::filesystem::path(shader_cache_directory) / name;
+}
+
+static bool shader_cache_supported() {
+    if (shader_cache_directory.empty()) { return false; }
+    int formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+// Cache file layout: binary format (GLenum), binary size (uint64) and the binary itself
+static unsigned int load_cached_program(std::filesystem::path const& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) { return 0; }
+
+    std::uint32_t format = 0;
+    std::uint64_t size = 0;
+    file.read(reinterpret_cast<char*>(&format), sizeof(format));
+    file.read(reinterpret_cast<char*>(&size), sizeof(size));
+    if (!file) { return 0; }
+
+    // Check the size before allocating, a corrupt or truncated entry must fall back to compiling instead of throwing
+    std::error_code error;
+    std::uintmax_t const file_size = std::filesystem::file_size(path, error);
+    std::uint64_t const header_size = sizeof(format) + sizeof(size);
+    if (error || size == 0 || file_size < header_size || size != file_size - header_size
+        || size > static_cast<std::uint64_t>(std::numeric_limits<int>::max())) {
+        return 0;
+    }
+    std::vector<char> binary(size);
+    file.read(binary.data(), size);
+    if (!file) { return 0; }
+
+    unsigned int prog = glCreateProgram();
+    glProgramBinary(prog, format, binary.data(), size);
+    int success;
+    glGetProgramiv(prog, GL_LINK_STATUS, &success);
+    // The driver changed or the file is corrupt, we'll compile from source and overwrite the entry
+    if (!success) {
+        glDeleteProgram(prog);
+        return 0;
+    }
+    return prog;
+}
+
+static void store_cached_program(std::filesystem::path const& path, unsigned int prog) {
+    int size = 0;
+    glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0) { return; }
+    std::vector<char> binary(size);
+    GLenum format = 0;
+    glGetProgramBinary(prog, size, nullptr, &format, binary.data());
+
+    std::uint32_t const format_u32 = format;
+    std::uint64_t const size_u64 = size;
+    write_file_atomic(path, {{&format_u32, sizeof(format_u32)}, {&size_u64, sizeof(size_u64)},
+                             {binary.data(), binary.size()}});
+}
+
 void set_wireframe(bool wireframe) {
     glPolygonMode(GL_FRONT_AND_BACK, wireframe ? GL_LINE : GL_FILL);
 }
@@ -44,6 +156,17 @@ unsigned int load_shader(const char* vtx_path, const char* frag_path, const char
     using namespace std::literals::string_literals;
     std::string vertex = read_file(vtx_path);
     std::string fragment = read_file(frag_path);
+    std::string geometry = geom_path ? read_file(geom_path) : "";
+
+    bool const use_cache = shader_cache_supported();
+    std::filesystem::path cache_path;
+    if (use_cache) {
+        cache_path = shader_cache_path(vertex, fragment, geometry);
+        if (unsigned int prog = load_cached_program(cache_path)) {
+            return prog;
+        }
+    }
+
     unsigned int vtx = create_shader_stage(GL_VERTEX_SHADER, vertex.c_str());
     unsigned int frag = create_shader_stage(GL_FRAGMENT_SHADER, fragment.c_str());
 
@@ -54,11 +177,13 @@ unsigned int load_shader(const char* vtx_path, const char* frag_path, const char
     unsigned int geom = 0;
 
     if (geom_path) {
-        std::string geometry = read_file(geom_path);
         geom = create_shader_stage(GL_GEOMETRY_SHADER, geometry.c_str());
         glAttachShader(prog, geom);
     }
 
+    if (use_cache) {
+        glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(prog);
     int success;
     char infolog[512];
@@ -76,6 +201,10 @@ unsigned int load_shader(const char* vtx_path, const char* frag_path, const char
         glDeleteShader(geom);
     }
 
+    if (use_cache) {
+        store_cached_program(cache_path, prog);
+    }
+
     return prog;
 }
 
@@ -85,14 +214,16 @@ unsigned int load_texture(const char* path) {
     unsigned char* data = stbi_load(path, &w, &h, &channels, 4);
 
     unsigned int texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+    if (data) {
+        glTextureStorage2D(texture, mip_level_count(w, h), GL_RGBA8, w, h);
+        glTextureSubImage2D(texture, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        glGenerateTextureMipmap(texture);
+    }
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
     stbi_image_free(data);
     
     return texture;
@@ -103,8 +234,8 @@ unsigned int load_cubemap(const char* descriptor_path) {
     if (!paths.good()) { return 0; }
 
     unsigned int texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+    glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &texture);
+    bool has_storage = false;
 
     for (size_t face = 0; face < 6; ++face) {
         std::string path;
@@ -118,48 +249,230 @@ unsigned int load_cubemap(const char* descriptor_path) {
             std::cout << "Oof\n";
         }
         else {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            // Immutable storage needs the size up front, every face has the size of the first one
+            if (!has_storage) {
+                glTextureStorage2D(texture, 1, GL_RGBA8, w, h);
+                has_storage = true;
+            }
+            glTextureSubImage3D(texture, 0, 0, 0, face, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
         }
 
         stbi_image_free(data);
     }
 
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     
     return texture;
 }
 
 unsigned int texture_from_buffer(unsigned char const* buf, size_t w, size_t h) {
     unsigned int tex;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, w, h);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RED, GL_UNSIGNED_BYTE, buf);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+    glTextureStorage2D(tex, 1, GL_R8, w, h);
+    glTextureSubImage2D(tex, 0, 0, 0, w, h, GL_RED, GL_UNSIGNED_BYTE, buf);
+    glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
     return tex;
 }
 
 unsigned int texture_from_buffer(float const* buf, size_t w, size_t h) {
     unsigned int tex;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, w, h);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RED, GL_FLOAT, buf);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+    glTextureStorage2D(tex, 1, GL_R32F, w, h);
+    glTextureSubImage2D(tex, 0, 0, 0, w, h, GL_RED, GL_FLOAT, buf);
+    glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    return tex;
+}
+
+size_t mip_level_count(size_t w, size_t h) {
+    size_t levels = 1;
+    while (w > 1 || h > 1) {
+        w = std::max<size_t>(1, w / 2);
+        h = std::max<size_t>(1, h / 2);
+        ++levels;
+    }
+    return levels;
+}
+
+// Calls fn(first_row, end_row) for ranges of rows on separate threads
+template<typename F>
+static void parallel_rows(size_t rows, F&& fn) {
+    // Small levels aren't worth starting threads for
+    constexpr size_t min_rows_per_thread = 64;
+    size_t const cores = std::max(1u, std::thread::hardware_concurrency());
+    size_t const thread_count = std::clamp<size_t>(rows / min_rows_per_thread, 1, cores);
+    if (thread_count == 1) {
+        fn(0, rows);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    size_t const rows_per_thread = (rows + thread_count - 1) / thread_count;
+    for (size_t first = 0; first < rows; first += rows_per_thread) {
+        threads.emplace_back(fn, first, std::min(rows, first + rows_per_thread));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void build_heightmap_mips(float const* buf, size_t w, size_t h, std::vector<std::vector<float>>& levels) {
+    levels.resize(mip_level_count(w, h) - 1);
+    float const* src = buf;
+    size_t src_w = w, src_h = h;
+    for (auto& level : levels) {
+        size_t const dst_w = std::max<size_t>(1, src_w / 2);
+        size_t const dst_h = std::max<size_t>(1, src_h / 2);
+        level.resize(dst_w * dst_h);
+        float* const dst = level.data();
+        parallel_rows(dst_h, [=] (size_t first_row, size_t end_row) {
+            for (size_t y = first_row; y < end_row; ++y) {
+                // Clamp for levels that are 1 texel wide or high in one direction
+                size_t const y0 = std::min(2 * y, src_h - 1);
+                size_t const y1 = std::min(2 * y + 1, src_h - 1);
+                for (size_t x = 0; x < dst_w; ++x) {
+                    size_t const x0 = std::min(2 * x, src_w - 1);
+                    size_t const x1 = std::min(2 * x + 1, src_w - 1);
+                    dst[y * dst_w + x] = 0.25f * (src[y0 * src_w + x0] + src[y0 * src_w + x1] + 
+                                                  src[y1 * src_w + x0] + src[y1 * src_w + x1]);
+                }
+            }
+        });
+        src = dst;
+        src_w = dst_w;
+        src_h = dst_h;
+    }
+}
+
+static void to_unorm16(float const* src, size_t count, std::vector<std::uint16_t>& dst) {
+    dst.resize(count);
+    std::uint16_t* const out = dst.data();
+    // Converted in blocks of texels, the layout in rows doesn't matter here
+    constexpr size_t block = 4096;
+    parallel_rows((count + block - 1) / block, [=] (size_t first, size_t end) {
+        for (size_t i = first * block; i < std::min(count, end * block); ++i) {
+            out[i] = (std::uint16_t)(std::clamp(src[i], 0.0f, 1.0f) * 65535.0f + 0.5f);
+        }
+    });
+}
+
+static void set_heightmap_sampling(unsigned int tex) {
+    glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+unsigned int heightmap_texture_from_buffer(float const* buf, size_t w, size_t h, HeightmapFormat format) {
+    std::vector<std::vector<float>> levels;
+    build_heightmap_mips(buf, w, h, levels);
+
+    unsigned int tex;
+    glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+    glTextureStorage2D(tex, levels.size() + 1, format == HeightmapFormat::R16 ? GL_R16 : GL_R32F, w, h);
+    // Rows of 16 bit texels aren't always a multiple of 4 bytes
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    std::vector<std::uint16_t> unorm;
+    size_t level_w = w, level_h = h;
+    for (size_t level = 0; level <= levels.size(); ++level) {
+        float const* data = level == 0 ? buf : levels[level - 1].data();
+        if (format == HeightmapFormat::R16) {
+            to_unorm16(data, level_w * level_h, unorm);
+            glTextureSubImage2D(tex, level, 0, 0, level_w, level_h, GL_RED, GL_UNSIGNED_SHORT, unorm.data());
+        } else {
+            glTextureSubImage2D(tex, level, 0, 0, level_w, level_h, GL_RED, GL_FLOAT, data);
+        }
+        level_w = std::max<size_t>(1, level_w / 2);
+        level_h = std::max<size_t>(1, level_h / 2);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    set_heightmap_sampling(tex);
+
+    return tex;
+}
+
+void build_heightmap_texels(float const* buf, size_t w, size_t h, HeightmapFormat format, HeightmapTexels& texels) {
+    std::vector<std::vector<float>> levels;
+    build_heightmap_mips(buf, w, h, levels);
+
+    texels.format = format;
+    texels.width = w;
+    texels.height = h;
+    texels.r16.clear();
+    texels.r32f.clear();
+    if (format == HeightmapFormat::R16) {
+        texels.r16.resize(levels.size() + 1);
+        size_t level_w = w, level_h = h;
+        for (size_t level = 0; level <= levels.size(); ++level) {
+            to_unorm16(level == 0 ? buf : levels[level - 1].data(), level_w * level_h, texels.r16[level]);
+            level_w = std::max<size_t>(1, level_w / 2);
+            level_h = std::max<size_t>(1, level_h / 2);
+        }
+    } else {
+        texels.r32f.reserve(levels.size() + 1);
+        texels.r32f.emplace_back(buf, buf + w * h);
+        for (auto& level : levels) {
+            texels.r32f.push_back(std::move(level));
+        }
+    }
+}
 
+unsigned int create_heightmap_texture(HeightmapTexels const& texels) {
+    unsigned int tex;
+    glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+    GLenum const internal_format = texels.format == HeightmapFormat::R16 ? GL_R16 : GL_R32F;
+    glTextureStorage2D(tex, mip_level_count(texels.width, texels.height), internal_format, texels.width, texels.height);
+    set_heightmap_sampling(tex);
     return tex;
 }
 
+bool upload_heightmap_texels(unsigned int texture, HeightmapTexels const& texels, HeightmapUploadCursor& cursor, size_t max_bytes) {
+    bool const r16 = texels.format == HeightmapFormat::R16;
+    size_t const level_count = r16 ? texels.r16.size() : texels.r32f.size();
+    size_t const texel_size = r16 ? sizeof(std::uint16_t) : sizeof(float);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    size_t uploaded = 0;
+    // Always upload at least one row, so every call makes progress
+    while (cursor.level < level_count && (uploaded == 0 || uploaded < max_bytes)) {
+        size_t const level_w = std::max<size_t>(1, texels.width >> cursor.level);
+        size_t const level_h = std::max<size_t>(1, texels.height >> cursor.level);
+        size_t const row_bytes = level_w * texel_size;
+        size_t const rows = std::clamp<size_t>((max_bytes - std::min(uploaded, max_bytes)) / row_bytes, 1, level_h - cursor.row);
 
-}
\ No newline at end of file
+        size_t const offset = cursor.row * level_w;
+        if (r16) {
+            glTextureSubImage2D(texture, cursor.level, 0, cursor.row, level_w, rows, GL_RED, GL_UNSIGNED_SHORT, 
+                                texels.r16[cursor.level].data() + offset);
+        } else {
+            glTextureSubImage2D(texture, cursor.level, 0, cursor.row, level_w, rows, GL_RED, GL_FLOAT, 
+                                texels.r32f[cursor.level].data() + offset);
+        }
+        uploaded += rows * row_bytes;
+
+        cursor.row += rows;
+        if (cursor.row == level_h) {
+            cursor.row = 0;
+            ++cursor.level;
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    return cursor.level == level_count;
+}
+
+}
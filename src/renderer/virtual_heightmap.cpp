@@ -0,0 +1,204 @@
+#include "renderer/virtual_heightmap.hpp"
+#include "renderer/gl_state.hpp"
+#include "renderer/util.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace titan::renderer {
+
+static size_t slot_size(VirtualHeightmap const& heightmap) {
+    return heightmap.info.page_size + 2;
+}
+
+float build_virtual_heightmap_fallback(HeightmapTerrain const& terrain, VirtualHeightmapInfo const& info,
+                                       HeightmapTexels& texels) {
+    std::vector<std::vector<float>> levels;
+    build_heightmap_mips(terrain.height_map.data(), terrain.heightmap_width, terrain.heightmap_height, levels);
+
+    // First level that fits in fallback_size
+    size_t level = 0;
+    size_t w = terrain.heightmap_width, h = terrain.heightmap_height;
+    while (std::max(w, h) > info.fallback_size && level < levels.size()) {
+        w = std::max<size_t>(1, w / 2);
+        h = std::max<size_t>(1, h / 2);
+        ++level;
+    }
+    float const* data = level == 0 ? terrain.height_map.data() : levels[level - 1].data();
+    build_heightmap_texels(data, w, h, HeightmapFormat::R16, texels);
+    return level;
+}
+
+void create_virtual_heightmap(VirtualHeightmap& heightmap, HeightmapTerrain const& terrain, VirtualHeightmapInfo const& info) {
+    HeightmapTexels fallback;
+    float const level_offset = build_virtual_heightmap_fallback(terrain, info, fallback);
+    create_virtual_heightmap_deferred(heightmap, terrain, info, fallback, level_offset);
+    HeightmapUploadCursor cursor;
+    upload_heightmap_texels(heightmap.fallback.get(), fallback, cursor, std::numeric_limits<size_t>::max());
+}
+
+void create_virtual_heightmap_deferred(VirtualHeightmap& heightmap, HeightmapTerrain const& terrain,
+                                       VirtualHeightmapInfo const& info, HeightmapTexels const& fallback,
+                                       float fallback_level_offset) {
+    heightmap.info = info;
+    heightmap.width = terrain.heightmap_width;
+    heightmap.height = terrain.heightmap_height;
+    heightmap.pages_x = (heightmap.width + info.page_size - 1) / info.page_size;
+    heightmap.pages_y = (heightmap.height + info.page_size - 1) / info.page_size;
+
+    size_t const atlas_size = info.atlas_pages * slot_size(heightmap);
+    heightmap.atlas = make_texture(GL_TEXTURE_2D);
+    unsigned int const atlas = heightmap.atlas.get();
+    glTextureStorage2D(atlas, 1, GL_R16, atlas_size, atlas_size);
+    glTextureParameteri(atlas, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(atlas, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(atlas, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(atlas, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    size_t const page_count = heightmap.pages_x * heightmap.pages_y;
+    heightmap.page_table_data.assign(4 * page_count, 0);
+    heightmap.page_table = make_texture(GL_TEXTURE_2D);
+    unsigned int const page_table = heightmap.page_table.get();
+    glTextureStorage2D(page_table, 1, GL_RGBA8UI, heightmap.pages_x, heightmap.pages_y);
+    glTextureParameteri(page_table, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTextureParameteri(page_table, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureSubImage2D(page_table, 0, 0, 0, heightmap.pages_x, heightmap.pages_y, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE,
+                        heightmap.page_table_data.data());
+
+    heightmap.fallback = GLTexture(create_heightmap_texture(fallback));
+    heightmap.fallback_level_offset = fallback_level_offset;
+
+    heightmap.page_slot.assign(page_count, VirtualHeightmap::no_page);
+    heightmap.slot_page.assign(info.atlas_pages * info.atlas_pages, VirtualHeightmap::no_page);
+}
+
+void destroy_virtual_heightmap(VirtualHeightmap& heightmap) {
+    // The textures are queued in the DeletionQueue
+    heightmap = VirtualHeightmap{};
+}
+
+// Copies a page and its border out of the heightmap and converts it to 16 bit
+static void upload_page(VirtualHeightmap& heightmap, HeightmapTerrain const& terrain, size_t page, size_t slot) {
+    size_t const size = slot_size(heightmap);
+    size_t const page_size = heightmap.info.page_size;
+    // Top left texel of the border, can be -1
+    std::int64_t const first_x = (std::int64_t)(page % heightmap.pages_x * page_size) - 1;
+    std::int64_t const first_y = (std::int64_t)(page / heightmap.pages_x * page_size) - 1;
+
+    heightmap.page_texels.resize(size * size);
+    for (size_t y = 0; y < size; ++y) {
+        size_t const src_y = std::clamp<std::int64_t>(first_y + y, 0, heightmap.height - 1);
+        for (size_t x = 0; x < size; ++x) {
+            size_t const src_x = std::clamp<std::int64_t>(first_x + x, 0, heightmap.width - 1);
+            float const value = terrain.height_map[src_y * heightmap.width + src_x];
+            heightmap.page_texels[y * size + x] = (std::uint16_t)(std::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+        }
+    }
+
+    size_t const slot_x = slot % heightmap.info.atlas_pages;
+    size_t const slot_y = slot / heightmap.info.atlas_pages;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTextureSubImage2D(heightmap.atlas.get(), 0, slot_x * size, slot_y * size, size, size, GL_RED, GL_UNSIGNED_SHORT,
+                        heightmap.page_texels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    std::uint8_t* entry = &heightmap.page_table_data[4 * page];
+    entry[0] = slot_x;
+    entry[1] = slot_y;
+    entry[2] = 1;
+    heightmap.page_slot[page] = slot;
+    heightmap.slot_page[slot] = page;
+}
+
+void update_virtual_heightmap(VirtualHeightmap& heightmap, HeightmapTerrain const& terrain, float const* cam_pos) {
+    heightmap.uploaded_pages = 0;
+
+    // Worldspace size of a page
+    float const page_w = heightmap.info.page_size * terrain.width / heightmap.width;
+    float const page_h = heightmap.info.page_size * terrain.length / heightmap.height;
+
+    size_t const page_count = heightmap.page_slot.size();
+    heightmap.page_distance.resize(page_count);
+    heightmap.order.clear();
+    for (size_t page = 0; page < page_count; ++page) {
+        float const min_x = (page % heightmap.pages_x) * page_w;
+        float const min_y = (page / heightmap.pages_x) * page_h;
+        float const dx = std::max({min_x - cam_pos[0], 0.0f, cam_pos[0] - (min_x + page_w)});
+        float const dy = std::max({min_y - cam_pos[1], 0.0f, cam_pos[1] - (min_y + page_h)});
+        heightmap.page_distance[page] = std::sqrt(dx * dx + dy * dy);
+        if (heightmap.page_slot[page] == VirtualHeightmap::no_page) {
+            heightmap.order.push_back(page);
+        }
+    }
+
+    // Nearest missing pages first
+    size_t const candidates = std::min(heightmap.info.pages_per_frame, heightmap.order.size());
+    std::partial_sort(heightmap.order.begin(), heightmap.order.begin() + candidates, heightmap.order.end(),
+                      [&heightmap] (std::uint32_t a, std::uint32_t b) {
+                          return heightmap.page_distance[a] < heightmap.page_distance[b];
+                      });
+
+    // Only replace a page once the new one is clearly closer, so pages on the edge of the resident area don't
+    // get swapped in and out every frame
+    float const hysteresis = 0.5f * std::min(page_w, page_h);
+    for (size_t i = 0; i < candidates; ++i) {
+        std::uint32_t const page = heightmap.order[i];
+
+        // Use a free slot, or the slot of the furthest resident page
+        size_t slot = heightmap.slot_page.size();
+        float furthest = -1.0f;
+        for (size_t candidate = 0; candidate < heightmap.slot_page.size(); ++candidate) {
+            std::uint32_t const resident = heightmap.slot_page[candidate];
+            if (resident == VirtualHeightmap::no_page) {
+                slot = candidate;
+                break;
+            }
+            if (heightmap.page_distance[resident] > furthest) {
+                furthest = heightmap.page_distance[resident];
+                slot = candidate;
+            }
+        }
+
+        std::uint32_t const evicted = heightmap.slot_page[slot];
+        if (evicted != VirtualHeightmap::no_page) {
+            // The atlas already holds closer pages than any that are missing
+            if (furthest <= heightmap.page_distance[page] + hysteresis) { break; }
+            heightmap.page_slot[evicted] = VirtualHeightmap::no_page;
+            heightmap.page_table_data[4 * evicted + 2] = 0;
+        }
+
+        upload_page(heightmap, terrain, page, slot);
+        ++heightmap.uploaded_pages;
+    }
+
+    if (heightmap.uploaded_pages != 0) {
+        glTextureSubImage2D(heightmap.page_table.get(), 0, 0, 0, heightmap.pages_x, heightmap.pages_y, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE,
+                            heightmap.page_table_data.data());
+    }
+}
+
+size_t resident_page_count(VirtualHeightmap const& heightmap) {
+    return std::count_if(heightmap.slot_page.begin(), heightmap.slot_page.end(),
+                         [] (std::uint32_t page) { return page != VirtualHeightmap::no_page; });
+}
+
+void bind_height_map(unsigned int height_map, VirtualHeightmap const& heightmap) {
+    bool const virtual_texture = static_cast<bool>(heightmap.atlas);
+    if (virtual_texture) {
+        GLStateCache::bind_texture_unit(6, heightmap.page_table.get());
+        GLStateCache::bind_texture_unit(7, heightmap.fallback.get());
+        glUniform4f(15, heightmap.width, heightmap.height, heightmap.info.page_size, slot_size(heightmap));
+        glUniform1f(16, heightmap.fallback_level_offset);
+    }
+    GLStateCache::bind_texture_unit(0, virtual_texture ? heightmap.atlas.get() : height_map);
+    glUniform1i(12, virtual_texture);
+    // Always point the page table and fallback samplers at their own units. Samplers of different types on the
+    // same unit make draws fail, even when the shader never reads them
+    glUniform1i(13, 6);
+    glUniform1i(14, 7);
+}
+
+}
@@ -0,0 +1,226 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace titan::trace {
+
+std::uint64_t now() {
+    auto const time = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+}
+
+#if TITAN_ENABLE_TRACING
+
+namespace {
+
+struct Event {
+    char const* name;
+    std::uint64_t start;
+    std::uint64_t end;
+};
+
+// Ring buffer slot. write_chrome_trace copies slots while their thread may be overwriting them, so every field is an
+// atomic. Relaxed is enough, the written counter and the fences around it tell which copies can be trusted.
+struct EventSlot {
+    std::atomic<char const*> name = nullptr;
+    std::atomic<std::uint64_t> start = 0;
+    std::atomic<std::uint64_t> end = 0;
+
+    void store(Event const& event) {
+        name.store(event.name, std::memory_order_relaxed);
+        start.store(event.start, std::memory_order_relaxed);
+        end.store(event.end, std::memory_order_relaxed);
+    }
+
+    Event load() const {
+        return Event{name.load(std::memory_order_relaxed), start.load(std::memory_order_relaxed),
+                     end.load(std::memory_order_relaxed)};
+    }
+};
+
+// Zones per thread before the oldest ones get overwritten
+constexpr size_t ring_capacity = 16384;
+// Buffers of finished threads are kept so their zones still show up in the trace. Past this amount, the buffer of
+// the finished thread with the oldest zones gets reused.
+constexpr size_t max_buffers = 64;
+
+struct ThreadBuffer {
+    std::vector<EventSlot> events = std::vector<EventSlot>(ring_capacity);
+    // Total amount of zones recorded, the ring position is written % ring_capacity
+    std::atomic<std::uint64_t> written = 0;
+    // Value of written at the last clear(). Only the owning thread writes to written, so clear() can't reset it
+    std::atomic<std::uint64_t> cleared = 0;
+    std::atomic<char const*> name = nullptr;
+    std::uint32_t thread_id = 0;
+    bool finished = false;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::uint32_t next_thread_id = 1;
+};
+
+Registry& get_registry() {
+    // Never destroyed, threads may still record zones while static destructors run
+    static Registry* registry = new Registry;
+    return *registry;
+}
+
+ThreadBuffer* acquire_buffer() {
+    auto& registry = get_registry();
+    std::lock_guard lock(registry.mutex);
+
+    ThreadBuffer* buffer = nullptr;
+    if (registry.buffers.size() < max_buffers) {
+        buffer = registry.buffers.emplace_back(std::make_unique<ThreadBuffer>()).get();
+    } else {
+        std::uint64_t oldest = UINT64_MAX;
+        for (auto& candidate : registry.buffers) {
+            if (!candidate->finished) { continue; }
+            std::uint64_t const written = candidate->written.load();
+            std::uint64_t const last = written ? candidate->events[(written - 1) % ring_capacity].end.load(std::memory_order_relaxed) : 0;
+            if (last < oldest) {
+                oldest = last;
+                buffer = candidate.get();
+            }
+        }
+        // Every buffer belongs to a running thread, this thread simply isn't traced
+        if (!buffer) { return nullptr; }
+        buffer->written.store(0);
+        buffer->cleared.store(0);
+        buffer->name.store(nullptr);
+        buffer->finished = false;
+    }
+    buffer->thread_id = registry.next_thread_id++;
+    return buffer;
+}
+
+// Owns the buffer of a thread and marks it as finished when the thread exits
+struct ThreadState {
+    ThreadBuffer* buffer = acquire_buffer();
+
+    ~ThreadState() {
+        if (!buffer) { return; }
+        std::lock_guard lock(get_registry().mutex);
+        buffer->finished = true;
+    }
+};
+
+ThreadBuffer* get_thread_buffer() {
+    thread_local ThreadState state;
+    return state.buffer;
+}
+
+void write_json_string(std::ofstream& file, char const* str) {
+    file << '"';
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\') { file << '\\'; }
+        file << *str;
+    }
+    file << '"';
+}
+
+}
+
+void record(char const* name, std::uint64_t start, std::uint64_t end) {
+    ThreadBuffer* buffer = get_thread_buffer();
+    if (!buffer) { return; }
+    // Only this thread writes, so a relaxed load is enough. The release store publishes the event to write_chrome_trace
+    std::uint64_t const index = buffer->written.load(std::memory_order_relaxed);
+    // Pairs with the acquire fence in write_chrome_trace. A copy that sees any field of this event also sees written
+    // at index or later, so it knows the slot may have changed under it
+    std::atomic_thread_fence(std::memory_order_release);
+    buffer->events[index % ring_capacity].store(Event{name, start, end});
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+void set_thread_name(char const* name) {
+    ThreadBuffer* buffer = get_thread_buffer();
+    if (!buffer) { return; }
+    buffer->name.store(name);
+}
+
+void write_chrome_trace(std::string const& path) {
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Could not open trace file " + path);
+    }
+
+    auto& registry = get_registry();
+    std::lock_guard lock(registry.mutex);
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    auto separator = [&file, &first] () {
+        if (!first) { file << ",\n"; }
+        first = false;
+    };
+
+    std::vector<Event> events;
+    for (auto const& buffer : registry.buffers) {
+        // Threads keep recording while we copy, so only keep the events that can't have been overwritten in the meantime
+        std::uint64_t const end = buffer->written.load(std::memory_order_acquire);
+        std::uint64_t const begin = std::max(end > ring_capacity ? end - ring_capacity : 0, buffer->cleared.load());
+        events.clear();
+        for (std::uint64_t i = begin; i < end; ++i) {
+            events.push_back(buffer->events[i % ring_capacity].load());
+        }
+        // Seqlock style check, the copies above can't move past the load of written_after
+        std::atomic_thread_fence(std::memory_order_acquire);
+        std::uint64_t const written_after = buffer->written.load(std::memory_order_relaxed);
+        // One more for a write that may be in progress but isn't counted yet
+        size_t const overwritten = written_after + 1 > ring_capacity + begin ? written_after + 1 - ring_capacity - begin : 0;
+        if (overwritten >= events.size()) { continue; }
+
+        if (char const* name = buffer->name.load()) {
+            separator();
+            file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_id << ",\"args\":{\"name\":";
+            write_json_string(file, name);
+            file << "}}";
+        }
+
+        for (size_t i = overwritten; i < events.size(); ++i) {
+            auto const& event = events[i];
+            separator();
+            // Chrome wants microseconds
+            file << "{\"name\":";
+            write_json_string(file, event.name);
+            file << ",\"cat\":\"titan\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread_id
+                 << ",\"ts\":" << event.start / 1000 << "." << event.start % 1000 / 100
+                 << ",\"dur\":" << (event.end - event.start) / 1000 << "." << (event.end - event.start) % 1000 / 100 << "}";
+        }
+    }
+    file << "\n]}\n";
+}
+
+void clear() {
+    auto& registry = get_registry();
+    std::lock_guard lock(registry.mutex);
+    for (auto& buffer : registry.buffers) {
+        buffer->cleared.store(buffer->written.load());
+    }
+}
+
+#else
+
+void record(char const*, std::uint64_t, std::uint64_t) {}
+
+void set_thread_name(char const*) {}
+
+void write_chrome_trace(std::string const&) {
+    throw std::runtime_error("Tracing is disabled, build with TITAN_ENABLE_TRACING");
+}
+
+void clear() {}
+
+#endif
+
+}